@@ -0,0 +1,334 @@
+#include "src/generator.h"
+#include "src/ProgramOptions.h"
+#include "src/canvas.h"
+#include "src/umg_include.h"
+#include "src/optimizer.h"
+#include <sys/resource.h>
+
+// GCC can't tell that the replaced operator new below pairs with the replaced delete.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+// Every heap allocation is counted. The size is stored in front of the block so that the number of live bytes,
+// and its peak, can be tracked as well.
+static long long allocationCount = 0;
+static long long allocatedBytes = 0;
+static long long liveBytes = 0;
+static long long peakLiveBytes = 0;
+
+const size_t allocationHeader = 16;
+
+void* operator new(size_t size) {
+  auto block = (char*) malloc(size + allocationHeader);
+  if (!block)
+    throw std::bad_alloc();
+  *(size_t*) block = size;
+  ++allocationCount;
+  allocatedBytes += size;
+  liveBytes += size;
+  peakLiveBytes = max(peakLiveBytes, liveBytes);
+  return block + allocationHeader;
+}
+
+void operator delete(void* ptr) noexcept {
+  if (ptr) {
+    auto block = (char*) ptr - allocationHeader;
+    liveBytes -= *(size_t*) block;
+    free(block);
+  }
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  operator delete(ptr);
+}
+
+struct Counters {
+  long long allocations;
+  long long bytes;
+  long long peakBytes;
+};
+
+static void resetCounters() {
+  allocationCount = 0;
+  allocatedBytes = 0;
+  peakLiveBytes = liveBytes;
+}
+
+static Counters getCounters(long long baseBytes) {
+  return Counters{allocationCount, allocatedBytes, peakLiveBytes - baseBytes};
+}
+
+static double getMillis(steady_clock::time_point begin) {
+  return duration_cast<microseconds>(steady_clock::now() - begin).count() / 1000.0;
+}
+
+static long long getMaxRssKb() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static po::parser getCommandLineFlags(int argc, char* argv[]) {
+  po::parser flags;
+  flags[""].type(po::string).multi().description("Programs to benchmark.");
+  flags["size"].type(po::i32).multi().fallback(64, 128, 256).description("Map sizes to run each program with.");
+  flags["seed"].type(po::i32).multi().fallback(1, 2, 3).description("Random seeds to run each program with.");
+  flags["output"].type(po::string).description("Write the JSON results to this file instead of stdout.");
+  flags["golden"].type(po::string).description("Check the hash of every generated map against this file.");
+  flags["update-golden"].description("Rewrite the file given by --golden with the current hashes.");
+  flags["compare-reference"].description("Also generate every map with the unoptimized program and compare tiles.");
+  flags["fast-rng"].description("Use the fast random number engine. The golden hashes are only valid without it.");
+  if (!flags.parseArgs(argc, argv))
+    exit(-1);
+  if (!flags[""].was_set() || (flags["update-golden"].was_set() && !flags["golden"].was_set())) {
+    std::cout << flags << endl;
+    exit(-1);
+  }
+  return flags;
+}
+
+static optional<string> readFile(const string& path) {
+  ifstream in(path);
+  if (!in.good())
+    return none;
+  stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+struct Result {
+  string program;
+  int size;
+  int seed;
+  bool success;
+  double parseMillis;
+  Counters parseCounters;
+  double generateMillis;
+  Counters generateCounters;
+  // Generating again into the same map, which should reuse its memory.
+  double regenerateMillis = 0;
+  Counters regenerateCounters {};
+  string hash;
+  optional<string> regenerateMismatch;
+  optional<string> referenceMismatch;
+};
+
+static void printCounters(ostream& o, const string& prefix, const Counters& c) {
+  o << ", \"" << prefix << "_allocations\": " << c.allocations
+    << ", \"" << prefix << "_allocated_bytes\": " << c.bytes
+    << ", \"" << prefix << "_peak_heap_bytes\": " << c.peakBytes;
+}
+
+static void printJson(ostream& o, const vector<Result>& results) {
+  o << "{\n  \"results\": [";
+  for (int i : All(results)) {
+    auto& r = results[i];
+    o << (i > 0 ? "," : "") << "\n    {\"program\": " << std::quoted(r.program) << ", \"size\": " << r.size
+      << ", \"seed\": " << r.seed << ", \"success\": " << (r.success ? "true" : "false")
+      << ", \"parse_ms\": " << r.parseMillis;
+    printCounters(o, "parse", r.parseCounters);
+    o << ", \"generate_ms\": " << r.generateMillis;
+    printCounters(o, "generate", r.generateCounters);
+    o << ", \"regenerate_ms\": " << r.regenerateMillis;
+    printCounters(o, "regenerate", r.regenerateCounters);
+    o << ", \"hash\": \"" << r.hash << "\"}";
+  }
+  o << "\n  ],\n  \"max_rss_kb\": " << getMaxRssKb() << "\n}\n";
+}
+
+// FNV-1a, so that the goldens don't depend on the standard library's std::hash.
+static string getHash(const LayoutCanvas::Map& map) {
+  unsigned long long hash = 14695981039346656037ull;
+  auto add = [&hash] (unsigned char c) {
+    hash = (hash ^ c) * 1099511628211ull;
+  };
+  for (auto v : map.elems.getBounds()) {
+    for (auto& token : map.elems[v]) {
+      for (char c : token.getName())
+        add(c);
+      add(0);
+    }
+    add(1);
+  }
+  stringstream ss;
+  ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return ss.str();
+}
+
+static optional<LayoutGenerator> parse(const string& path, const string& input) {
+  LayoutGenerator gen;
+  PrettyInputArchive ar({string(umgInclude), input}, {"include.umg", path}, nullptr);
+  try {
+    ar(gen);
+  } catch (PrettyException& ex) {
+    std::cerr << ex.text << "\n";
+    return none;
+  }
+  return std::move(gen);
+}
+
+static bool generate(const LayoutGenerator& gen, LayoutCanvas::Map& map, int seed, RandomEngine engine) {
+  RandomGen random;
+  random.init(seed, engine);
+  return gen.make(LayoutCanvas{map.elems.getBounds(), &map}, random);
+}
+
+static optional<LayoutCanvas::Map> generate(const LayoutGenerator& gen, int size, int seed, RandomEngine engine) {
+  LayoutCanvas::Map map(ChunkedTable<TokenList>(size, size));
+  if (!generate(gen, map, seed, engine))
+    return none;
+  return std::move(map);
+}
+
+static string printTile(const TokenList& tokens) {
+  string ret;
+  for (auto& t : tokens)
+    ret += (ret.empty() ? "" : ", ") + t.getName();
+  return "[" + ret + "]";
+}
+
+static optional<string> compareMaps(const optional<LayoutCanvas::Map>& map, const optional<LayoutCanvas::Map>& reference) {
+  if (!map || !reference) {
+    if (!!map == !!reference)
+      return none;
+    return string(map ? "only the reference program failed" : "only the optimized program failed");
+  }
+  for (auto v : map->elems.getBounds())
+    if (map->elems[v] != reference->elems[v])
+      return "first difference at (" + toString(v.x) + ", " + toString(v.y) + "): " + printTile(map->elems[v]) + " vs reference "
+          + printTile(reference->elems[v]);
+  return none;
+}
+
+static optional<Result> run(const string& path, const string& input, int size, int seed, RandomEngine engine,
+    bool compareReference) {
+  Result ret;
+  ret.program = path;
+  ret.size = size;
+  ret.seed = seed;
+  auto baseBytes = liveBytes;
+  resetCounters();
+  auto begin = steady_clock::now();
+  auto parsed = parse(path, input);
+  if (!parsed)
+    return none;
+  Arena arena;
+  auto gen = optimize(*parsed, arena);
+  ret.parseMillis = getMillis(begin);
+  ret.parseCounters = getCounters(baseBytes);
+  baseBytes = liveBytes;
+  resetCounters();
+  begin = steady_clock::now();
+  auto map = generate(gen, size, seed, engine);
+  ret.generateMillis = getMillis(begin);
+  ret.generateCounters = getCounters(baseBytes);
+  ret.success = !!map;
+  ret.hash = map ? getHash(*map) : "failed";
+  if (map) {
+    baseBytes = liveBytes;
+    resetCounters();
+    begin = steady_clock::now();
+    map->reset();
+    bool success = generate(gen, *map, seed, engine);
+    ret.regenerateMillis = getMillis(begin);
+    ret.regenerateCounters = getCounters(baseBytes);
+    if (!success || getHash(*map) != ret.hash)
+      ret.regenerateMismatch = string("generating again into the reset map gave a different result");
+  }
+  if (compareReference) {
+    auto reference = parse(path, input);
+    if (!reference)
+      return none;
+    ret.referenceMismatch = compareMaps(map, generate(*reference, size, seed, engine));
+  }
+  return ret;
+}
+
+static string getGoldenKey(const Result& r) {
+  return r.program + " " + toString(r.size) + " " + toString(r.seed);
+}
+
+static map<string, string> readGolden(const string& path) {
+  map<string, string> ret;
+  ifstream in(path);
+  string program, hash;
+  int size, seed;
+  while (in >> program >> size >> seed >> hash)
+    ret[program + " " + toString(size) + " " + toString(seed)] = hash;
+  return ret;
+}
+
+static void writeGolden(const string& path, const vector<Result>& results) {
+  ofstream out(path);
+  for (auto& r : results)
+    out << getGoldenKey(r) << " " << r.hash << "\n";
+}
+
+// Returns the number of runs whose hash is missing from the goldens or differs.
+static int checkGolden(const string& path, const vector<Result>& results) {
+  auto golden = readGolden(path);
+  int errors = 0;
+  for (auto& r : results) {
+    auto key = getGoldenKey(r);
+    if (auto hash = getReferenceMaybe(golden, key)) {
+      if (*hash != r.hash) {
+        std::cerr << key << ": hash " << r.hash << " doesn't match golden " << *hash << "\n";
+        ++errors;
+      }
+    } else {
+      std::cerr << key << ": no golden hash\n";
+      ++errors;
+    }
+  }
+  return errors;
+}
+
+int main(int argc, char* argv[]) {
+  po::parser flags = getCommandLineFlags(argc, argv);
+  bool compareReference = flags["compare-reference"].was_set();
+  auto engine = flags["fast-rng"].was_set() ? RandomEngine::FAST : RandomEngine::COMPATIBLE;
+  vector<Result> results;
+  int errors = 0;
+  for (auto& path : flags[""]) {
+    auto input = readFile(path.string);
+    if (!input) {
+      std::cerr << "Failed to open file: " << path.string << "\n";
+      return -1;
+    }
+    for (auto& size : flags["size"])
+      for (auto& seed : flags["seed"]) {
+        auto result = run(path.string, *input, size.i32, seed.i32, engine, compareReference);
+        if (!result)
+          return -1;
+        std::cerr << path.string << " size " << size.i32 << " seed " << seed.i32 << ": "
+            << result->generateMillis << " ms" << (result->success ? "" : " (failed)") << "\n";
+        if (result->referenceMismatch) {
+          std::cerr << getGoldenKey(*result) << ": " << *result->referenceMismatch << "\n";
+          ++errors;
+        }
+        if (result->regenerateMismatch) {
+          std::cerr << getGoldenKey(*result) << ": " << *result->regenerateMismatch << "\n";
+          ++errors;
+        }
+        results.push_back(*result);
+      }
+  }
+  if (flags["golden"].was_set()) {
+    auto path = flags["golden"].get().string;
+    if (flags["update-golden"].was_set())
+      writeGolden(path, results);
+    else
+      errors += checkGolden(path, results);
+  }
+  if (flags["output"].was_set()) {
+    ofstream out(flags["output"].get().string);
+    printJson(out, results);
+  } else if (!flags["golden"].was_set())
+    printJson(std::cout, results);
+  if (errors > 0) {
+    std::cerr << errors << " determinism errors\n";
+    return 1;
+  }
+  return 0;
+}
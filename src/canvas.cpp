@@ -0,0 +1,76 @@
+#include "canvas.h"
+#include "reroll.h"
+
+LayoutCanvas::Map::Map(ChunkedTable<TokenList> elems, Profiler* profiler)
+    : elems(std::move(elems)), profiler(profiler) {}
+
+void LayoutCanvas::Map::reset() {
+  elems.reset();
+  failure = nullptr;
+  stamps.clear();
+  distanceFields.clear();
+  distanceFieldLog.clear();
+  checkpoints.clear();
+  journal.clear();
+  if (journaledBy)
+    journaledBy->reset();
+  lastCheckpointId = 0;
+}
+
+TokenList& LayoutCanvas::Map::modify(Vec2 v) {
+  if (modified)
+    modified->push_back(v);
+  if (!distanceFields.empty())
+    logDistanceFieldChange(v);
+  if (!checkpoints.empty()) {
+    int id = checkpoints.back().id;
+    auto& journaled = journaledBy->modify(v);
+    if (journaled != id) {
+      journal.push_back(make_pair(v, elems[v]));
+      journaled = id;
+    }
+  }
+  return elems.modify(v);
+}
+
+void LayoutCanvas::Map::logDistanceFieldChange(Vec2 v) {
+  if (distanceFieldLog.size() < elems.getBounds().area())
+    distanceFieldLog.push_back(v);
+  else {
+    distanceFields.clear();
+    distanceFieldLog.clear();
+  }
+}
+
+int LayoutCanvas::Map::checkpoint() {
+  if (!journaledBy)
+    journaledBy.emplace(elems.getBounds(), 0);
+  checkpoints.push_back(Checkpoint{journal.size(), ++lastCheckpointId});
+  return checkpoints.size() - 1;
+}
+
+void LayoutCanvas::Map::commit(int checkpoint) {
+  CHECK(checkpoint == checkpoints.size() - 1);
+  checkpoints.pop_back();
+  // An outer checkpoint still needs the entries to roll back past this one.
+  if (checkpoints.empty())
+    journal.clear();
+}
+
+void LayoutCanvas::Map::rollback(int checkpoint) {
+  CHECK(checkpoint == checkpoints.size() - 1);
+  if (reroll)
+    reroll->rollback(checkpoint);
+  int journalSize = checkpoints.back().journalSize;
+  checkpoints.pop_back();
+  while (journal.size() > journalSize) {
+    if (!distanceFields.empty())
+      logDistanceFieldChange(journal.back().first);
+    elems.modify(journal.back().first) = std::move(journal.back().second);
+    journal.pop_back();
+  }
+}
+
+int LayoutCanvas::Map::getNumCheckpoints() const {
+  return checkpoints.size();
+}
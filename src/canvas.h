@@ -4,11 +4,118 @@
 #include "token.h"
 #include "util.h"
 
-using Token = string;
+class Profiler;
+class Reroll;
+struct LayoutGenerator;
+namespace TilePredicates {
+struct Distance;
+}
+
+// Buffers that nodes need while they run, kept with the map so that generating again doesn't allocate them again.
+// A buffer is taken for as long as the node runs, so nested nodes of the same kind get different ones.
+class ScratchBuffers {
+  public:
+  template <typename T>
+  class Lease {
+    public:
+    Lease(ScratchBuffers& pool, unique_ptr<vector<T>> buffer) : pool(pool), buffer(std::move(buffer)) {}
+    Lease(const Lease&) = delete;
+    ~Lease() {
+      pool.getFree<T>().push_back(std::move(buffer));
+    }
+    vector<T>& operator * () const {
+      return *buffer;
+    }
+    vector<T>* operator -> () const {
+      return buffer.get();
+    }
+
+    private:
+    ScratchBuffers& pool;
+    unique_ptr<vector<T>> buffer;
+  };
+
+  // Returns an empty buffer.
+  template <typename T>
+  Lease<T> get() {
+    auto& free = getFree<T>();
+    if (free.empty())
+      return Lease<T>(*this, unique_ptr<vector<T>>(new vector<T>()));
+    auto ret = std::move(free.back());
+    free.pop_back();
+    ret->clear();
+    return Lease<T>(*this, std::move(ret));
+  }
+
+  private:
+  template <typename T>
+  std::vector<unique_ptr<vector<T>>>& getFree() {
+    return std::get<std::vector<unique_ptr<vector<T>>>>(free);
+  }
+  std::tuple<std::vector<unique_ptr<vector<char>>>, std::vector<unique_ptr<vector<int>>>,
+      std::vector<unique_ptr<vector<double>>>, std::vector<unique_ptr<vector<Vec2>>>> free;
+};
 
 struct LayoutCanvas {
   struct Map {
-    Table<vector<Token>> elems;
+    Map(ChunkedTable<TokenList> elems, Profiler* profiler = nullptr);
+    // Empties the map for another generation of the same size, keeping its memory.
+    void reset();
+    ChunkedTable<TokenList> elems;
+    Profiler* profiler = nullptr;
+    Reroll* reroll = nullptr;
+    // The innermost node that returned false, if generation failed.
+    const LayoutGenerator* failure = nullptr;
+    // What a Stamp does to one tile. The tile is either replaced by the back tokens, or the front and back tokens
+    // that it doesn't contain yet are added at its front and back.
+    struct StampTile {
+      bool replace = false;
+      TokenList front;
+      TokenList back;
+    };
+    // Results of Stamp nodes by generator and area size. None means that the generator can't be stamped.
+    map<pair<const LayoutGenerator*, Vec2>, optional<Table<StampTile>>> stamps;
+    ScratchBuffers scratch;
+    // If set, every tile passed to modify() is added here, so that a node can tell which tiles its children changed.
+    vector<Vec2>* modified = nullptr;
+    // The sources and distances of every Distance predicate evaluated so far, column by column over the map.
+    struct DistanceField {
+      vector<char> sources;
+      vector<double> distances;
+      // How far the source predicate reads, or none if a modified tile may change any source.
+      optional<int> readRadius;
+      // The modified tiles up to here have been checked for changed sources.
+      int logPosition;
+      // Set when the sources changed after the distances were computed.
+      bool stale;
+      // The number of tiles looked at to answer queries since the distances became stale.
+      int staleChecks;
+    };
+    map<const TilePredicates::Distance*, DistanceField> distanceFields;
+    // Tiles modified while there are any distance fields. Once the log is as big as the map the fields are dropped
+    // instead, as catching up would cost as much as computing them again.
+    vector<Vec2> distanceFieldLog;
+
+    // All writes go through here, so that they can be rolled back.
+    TokenList& modify(Vec2);
+    // Tiles modified after a checkpoint are journaled until it's committed or rolled back. Checkpoints nest,
+    // and must be closed in reverse order.
+    int checkpoint();
+    void commit(int checkpoint);
+    void rollback(int checkpoint);
+    int getNumCheckpoints() const;
+
+    private:
+    struct Checkpoint {
+      int journalSize;
+      int id;
+    };
+    vector<Checkpoint> checkpoints;
+    vector<pair<Vec2, TokenList>> journal;
+    // Id of the checkpoint that last journaled each tile, so that a tile is saved only once per checkpoint.
+    optional<ChunkedTable<int>> journaledBy;
+    int lastCheckpointId = 0;
+    void logDistanceFieldChange(Vec2);
   };
   LayoutCanvas with(Rectangle area) const {
     //if (map->elems.getBounds().contains(area));
@@ -0,0 +1,104 @@
+#include "util.h"
+#include "distance_transform.h"
+
+static const double infinite = std::numeric_limits<double>::infinity();
+
+// Two passes with unit steps to all eight neighbors, which is exact for this metric (Rosenfeld and Pfaltz).
+static void genChebyshev(int width, int height, const vector<char>& sources, vector<double>& distances) {
+  auto at = [&] (int x, int y) -> double& {
+    return distances[x * height + y];
+  };
+  for (int x = 0; x < width; ++x)
+    for (int y = 0; y < height; ++y) {
+      auto& d = at(x, y);
+      d = sources[x * height + y] ? 0 : infinite;
+      if (y > 0)
+        d = min(d, at(x, y - 1) + 1);
+      if (x > 0)
+        for (int y1 = max(0, y - 1); y1 <= min(height - 1, y + 1); ++y1)
+          d = min(d, at(x - 1, y1) + 1);
+    }
+  for (int x = width - 1; x >= 0; --x)
+    for (int y = height - 1; y >= 0; --y) {
+      auto& d = at(x, y);
+      if (y < height - 1)
+        d = min(d, at(x, y + 1) + 1);
+      if (x < width - 1)
+        for (int y1 = max(0, y - 1); y1 <= min(height - 1, y + 1); ++y1)
+          d = min(d, at(x + 1, y1) + 1);
+    }
+}
+
+// The distance to the nearest source in the same column, then the lower envelope of the parabolas
+// (x - x1)^2 + d(x1)^2 along every row (Felzenszwalb and Huttenlocher).
+static void genEuclidean(int width, int height, const vector<char>& sources, vector<double>& distances) {
+  for (int x = 0; x < width; ++x) {
+    double* column = distances.data() + x * height;
+    double last = infinite;
+    for (int y = 0; y < height; ++y)
+      column[y] = last = sources[x * height + y] ? 0 : last + 1;
+    for (int y = height - 2; y >= 0; --y)
+      column[y] = min(column[y], column[y + 1] + 1);
+  }
+  vector<double> squared(width);
+  vector<int> parabolas(width);
+  vector<double> bounds(width + 1);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      double d = distances[x * height + y];
+      squared[x] = d * d;
+    }
+    // Columns without sources don't add a parabola, and if none has any then neither does any row.
+    int k = -1;
+    for (int x = 0; x < width; ++x) {
+      if (squared[x] == infinite)
+        continue;
+      double s = -infinite;
+      while (k >= 0) {
+        int x1 = parabolas[k];
+        s = ((squared[x] + x * x) - (squared[x1] + x1 * x1)) / (2 * (x - x1));
+        if (s > bounds[k])
+          break;
+        --k;
+      }
+      if (k < 0)
+        s = -infinite;
+      ++k;
+      parabolas[k] = x;
+      bounds[k] = s;
+    }
+    if (k < 0)
+      return;
+    bounds[k + 1] = infinite;
+    for (int x = 0, j = 0; x < width; ++x) {
+      while (bounds[j + 1] < x)
+        ++j;
+      int x1 = parabolas[j];
+      distances[x * height + y] = sqrt((x - x1) * (x - x1) + squared[x1]);
+    }
+  }
+}
+
+void genDistanceField(Rectangle area, DistanceMetric metric, const vector<char>& sources, vector<double>& distances) {
+  CHECK(sources.size() == area.width() * area.height());
+  distances.resize(sources.size());
+  switch (metric) {
+    case DistanceMetric::EUCLIDEAN:
+      genEuclidean(area.width(), area.height(), sources, distances);
+      break;
+    case DistanceMetric::CHEBYSHEV:
+      genChebyshev(area.width(), area.height(), sources, distances);
+      break;
+  }
+}
+
+double getDistance(DistanceMetric metric, Vec2 v1, Vec2 v2) {
+  auto diff = v1 - v2;
+  switch (metric) {
+    case DistanceMetric::EUCLIDEAN:
+      return sqrt(diff.x * diff.x + diff.y * diff.y);
+    case DistanceMetric::CHEBYSHEV:
+      return max(abs(diff.x), abs(diff.y));
+  }
+  fail();
+}
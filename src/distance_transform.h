@@ -0,0 +1,12 @@
+#pragma once
+
+#include "util.h"
+
+RICH_ENUM(DistanceMetric, EUCLIDEAN, CHEBYSHEV);
+
+// Writes the distance from every tile of the area to the nearest source, column by column, in time linear in the
+// area. A tile is a source if its entry in sources is nonzero. Without any sources all distances are infinite.
+void genDistanceField(Rectangle area, DistanceMetric, const vector<char>& sources, vector<double>& distances);
+
+// The distance between two tiles.
+double getDistance(DistanceMetric, Vec2, Vec2);
@@ -36,6 +36,15 @@ struct VARIANT_NAME {
   bool contains() const {
     return !!getReferenceMaybe<T>();
   }
+  const char* getName() const {
+    switch (index) {
+#define X(Type, Index)\
+      case Index: return #Type;
+      VARIANT_TYPES_LIST
+#undef X
+      default: fail();
+    }
+  }
 #define X(Type, Index) \
   VARIANT_NAME(Type&& t) noexcept : index(Index), elem##Index(std::move(t)) {}\
   VARIANT_NAME(const Type& t) noexcept : index(Index), elem##Index(t) {}
@@ -49,6 +58,17 @@ struct VARIANT_NAME {
 #define X(Type, Index)\
       case Index: return f(elem##Index); break;
       VARIANT_TYPES_LIST
+#undef X
+      default: fail();
+    }
+  }
+  template<typename RetType = void, typename... Fs>
+  RetType visit(Fs... fs) {
+    auto f = variant_helpers::LambdaVisitor<Fs...>(fs...);
+    switch (index) {
+#define X(Type, Index)\
+      case Index: return f(elem##Index); break;
+      VARIANT_TYPES_LIST
 #undef X
       default: fail();
     }
@@ -0,0 +1,94 @@
+#include "generation_driver.h"
+#include "generator.h"
+#include "reroll.h"
+#include <thread>
+
+int getAttemptSeed(int seed, int attempt) {
+  if (attempt == 0)
+    return seed;
+  // splitmix64
+  unsigned long long z = ((unsigned long long) (unsigned) seed << 32) + (unsigned) attempt;
+  z += 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return int(z ^ (z >> 31));
+}
+
+static steady_clock::time_point getDeadline(const GenerationBudget& budget, steady_clock::time_point start) {
+  if (budget.time)
+    return start + *budget.time;
+  return steady_clock::time_point::max();
+}
+
+static GenerationAttempt runAttempt(const LayoutGenerator& gen, LayoutCanvas::Map& map, int index, int seed,
+    RandomEngine engine) {
+  auto start = steady_clock::now();
+  RandomGen random;
+  random.init(seed, engine);
+  bool success = gen.make(LayoutCanvas{map.elems.getBounds(), &map}, random);
+  return GenerationAttempt{index, seed, success, map.failure,
+      duration_cast<milliseconds>(steady_clock::now() - start)};
+}
+
+static GenerationResult generateSequential(const LayoutGenerator& gen, Vec2 size, int seed, RandomEngine engine,
+    const GenerationBudget& budget, Profiler* profiler, Reroll* reroll) {
+  GenerationResult ret;
+  auto deadline = getDeadline(budget, steady_clock::now());
+  for (int i = 0; i < budget.maxAttempts && (i == 0 || steady_clock::now() < deadline); ++i) {
+    LayoutCanvas::Map map(ChunkedTable<TokenList>(size.x, size.y), profiler);
+    if (reroll) {
+      reroll->reset();
+      map.reroll = reroll;
+    }
+    ret.attempts.push_back(runAttempt(gen, map, i, getAttemptSeed(seed, i), engine));
+    map.reroll = nullptr;
+    if (ret.attempts.back().success) {
+      ret.map = std::move(map);
+      break;
+    }
+  }
+  return ret;
+}
+
+static GenerationResult generateParallel(const LayoutGenerator& gen, Vec2 size, int seed, RandomEngine engine,
+    const GenerationBudget& budget) {
+  GenerationResult ret;
+  auto deadline = getDeadline(budget, steady_clock::now());
+  std::atomic<int> nextAttempt(0);
+  // Attempts above the lowest successful one so far are not started.
+  std::atomic<int> winner(budget.maxAttempts);
+  std::mutex mutex;
+  auto worker = [&] {
+    while (true) {
+      int index = nextAttempt++;
+      if (index >= winner || (index > 0 && steady_clock::now() >= deadline))
+        return;
+      LayoutCanvas::Map map(ChunkedTable<TokenList>(size.x, size.y));
+      auto attempt = runAttempt(gen, map, index, getAttemptSeed(seed, index), engine);
+      std::lock_guard<std::mutex> lock(mutex);
+      ret.attempts.push_back(attempt);
+      if (attempt.success && index < winner) {
+        winner = index;
+        ret.map = std::move(map);
+      }
+    }
+  };
+  vector<std::thread> threads;
+  for (int i = 0; i < budget.threads; ++i)
+    threads.emplace_back(worker);
+  for (auto& t : threads)
+    t.join();
+  std::sort(ret.attempts.begin(), ret.attempts.end(),
+      [](const auto& a, const auto& b) { return a.index < b.index; });
+  while (!ret.attempts.empty() && ret.attempts.back().index > winner)
+    ret.attempts.pop_back();
+  return ret;
+}
+
+GenerationResult generateWithRetries(const LayoutGenerator& gen, Vec2 size, int seed, RandomEngine engine,
+    const GenerationBudget& budget, Profiler* profiler, Reroll* reroll) {
+  CHECK(budget.maxAttempts >= 1);
+  if (budget.threads <= 1 || budget.maxAttempts == 1 || profiler || reroll)
+    return generateSequential(gen, size, seed, engine, budget, profiler, reroll);
+  return generateParallel(gen, size, seed, engine, budget);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "stdafx.h"
+#include "util.h"
+#include "canvas.h"
+
+struct LayoutGenerator;
+class Profiler;
+class Reroll;
+
+struct GenerationBudget {
+  int maxAttempts = 1;
+  // Checked before starting each attempt, a running attempt is never interrupted.
+  optional<milliseconds> time;
+  // Attempts are run speculatively on this many threads.
+  int threads = 1;
+};
+
+struct GenerationAttempt {
+  int index;
+  int seed;
+  bool success;
+  // The innermost node that failed.
+  const LayoutGenerator* failure;
+  milliseconds time;
+};
+
+struct GenerationResult {
+  optional<LayoutCanvas::Map> map;
+  // Sorted by index. Speculative attempts started after the winning one are not included.
+  vector<GenerationAttempt> attempts;
+};
+
+// The first attempt uses the given seed, so a map that succeeds straight away is the same as without retries.
+int getAttemptSeed(int seed, int attempt);
+
+// Retries with derived seeds until an attempt succeeds or the budget runs out. The lowest successful attempt
+// always wins, so the result doesn't depend on the number of threads, unless a time budget is hit.
+// The profiler and the reroll are only used when running on a single thread. The reroll records the successful
+// attempt.
+GenerationResult generateWithRetries(const LayoutGenerator&, Vec2 size, int seed, RandomEngine,
+    const GenerationBudget&, Profiler* = nullptr, Reroll* = nullptr);
@@ -2,28 +2,50 @@
 #include "canvas.h"
 #include "shortest_path.h"
 #include "perlin_noise.h"
+#include "profiler.h"
+#include "reroll.h"
+#include "optimizer.h"
+#include "path_abstraction.h"
+#include "distance_transform.h"
+
+// Visits the area chunk by chunk, for generators that don't draw random numbers and so can visit tiles in any order.
+template <typename Fun>
+static void forEachTile(LayoutCanvas c, Fun fun) {
+  const int chunkSize = decltype(c.map->elems)::chunkSize;
+  if (c.area.width() <= chunkSize && c.area.height() <= chunkSize) {
+    for (auto v : c.area)
+      fun(v);
+  } else
+    c.map->elems.forEachChunk(c.area, [&](Rectangle part) {
+      for (auto v : part)
+        fun(v);
+    });
+}
 
 bool make(const LayoutGenerators::Set& g, LayoutCanvas c, RandomGen&) {
-  for (auto v : c.area)
+  forEachTile(c, [&](Vec2 v) {
     for (auto& token : g.tokens)
       if (!c.map->elems[v].contains(token))
-        c.map->elems[v].push_back(token);
+        c.map->modify(v).push_back(token);
+  });
   return true;
 }
 
 bool make(const LayoutGenerators::SetFront& g, LayoutCanvas c, RandomGen&) {
-  for (auto v : c.area)
+  forEachTile(c, [&](Vec2 v) {
     if (!c.map->elems[v].contains(g.token))
-      c.map->elems[v].push_front(g.token);
+      c.map->modify(v).push_front(g.token);
+  });
   return true;
 }
 
 bool make(const LayoutGenerators::Reset& g, LayoutCanvas c, RandomGen&) {
-  for (auto v : c.area) {
-    c.map->elems[v].clear();
+  forEachTile(c, [&](Vec2 v) {
+    auto& tokens = c.map->modify(v);
+    tokens.clear();
     for (auto& token : g.tokens)
-      c.map->elems[v].push_back(token);
-  }
+      tokens.push_back(token);
+  });
   return true;
 }
 
@@ -39,78 +61,90 @@ bool make(const LayoutGenerators::Filter& g, LayoutCanvas c, RandomGen& r) {
 }
 
 bool make(const LayoutGenerators::Remove& g, LayoutCanvas c, RandomGen&) {
-  for (auto v : c.area)
+  forEachTile(c, [&](Vec2 v) {
     for (auto& token : g.tokens)
-      c.map->elems[v].removeElementMaybePreserveOrder(token);
+      if (c.map->elems[v].contains(token))
+        c.map->modify(v).removeElementMaybePreserveOrder(token);
+  });
   return true;
 }
 
+// The four borders, in the order in which they are generated.
+static vector<Rectangle> getBorderAreas(const LayoutGenerators::Margins& g, Rectangle area) {
+  return {
+    Rectangle(area.topLeft(), Vec2(area.right(), area.top() + g.width)),
+    Rectangle(Vec2(area.right() - g.width, area.top() + g.width), area.bottomRight()),
+    Rectangle(Vec2(area.left(), area.bottom() - g.width), Vec2(area.right() - g.width, area.bottom())),
+    Rectangle(Vec2(area.left(), area.top() + g.width), Vec2(area.left() + g.width, area.bottom() - g.width))
+  };
+}
+
 bool make(const LayoutGenerators::Margins& g, LayoutCanvas c, RandomGen& r) {
   if (!g.inside->make(c.with(c.area.minusMargin(g.width)), r))
     return false;
-  if (!g.border->make(c.with(Rectangle(c.area.topLeft(), Vec2(c.area.right(), c.area.top() + g.width))), r))
-    return false;
-  if (!g.border->make(c.with(Rectangle(
-      Vec2(c.area.right() - g.width, c.area.top() + g.width),
-      c.area.bottomRight())), r))
-    return false;
-  if (!g.border->make(c.with(Rectangle(
-      Vec2(c.area.left(), c.area.bottom() - g.width),
-      Vec2(c.area.right() - g.width, c.area.bottom()))), r))
-    return false;
-  return g.border->make(c.with(Rectangle(
-      Vec2(c.area.left(), c.area.top() + g.width),
-      Vec2(c.area.left() + g.width, c.area.bottom() - g.width))), r);
+  for (auto& border : getBorderAreas(g, c.area))
+    if (!g.border->make(c.with(border), r))
+      return false;
+  return true;
+}
+
+// The border and the inside.
+static pair<Rectangle, Rectangle> getMarginAreas(const LayoutGenerators::MarginImpl& g, Rectangle area) {
+  switch (g.type) {
+    case MarginType::TOP: return {
+          Rectangle(area.topLeft(), Vec2(area.right(), area.top() + g.width)),
+          Rectangle(Vec2(area.left(), area.top() + g.width), area.bottomRight())
+        };
+    case MarginType::BOTTOM: return {
+          Rectangle(Vec2(area.left(), area.bottom() - g.width), area.bottomRight()),
+          Rectangle(area.topLeft(), Vec2(area.right(), area.bottom() - g.width))
+        };
+    case MarginType::LEFT: return {
+          Rectangle(area.topLeft(), Vec2(area.left() + g.width, area.bottom())),
+          Rectangle(Vec2(area.left() + g.width, area.top()), area.bottomRight())
+        };
+    case MarginType::RIGHT: return {
+          Rectangle(Vec2(area.right() - g.width, area.top()), area.bottomRight()),
+          Rectangle(area.topLeft(), Vec2(area.right() - g.width, area.bottom()))
+        };
+  }
+  fail();
 }
 
 bool make(const LayoutGenerators::MarginImpl& g, LayoutCanvas c, RandomGen& r) {
-  auto rect = [&]() -> pair<Rectangle, Rectangle> {
-    switch (g.type) {
-      case MarginType::TOP: return {
-            Rectangle(c.area.topLeft(), Vec2(c.area.right(), c.area.top() + g.width)),
-            Rectangle(Vec2(c.area.left(), c.area.top() + g.width), c.area.bottomRight())
-          };
-      case MarginType::BOTTOM: return {
-            Rectangle(Vec2(c.area.left(), c.area.bottom() - g.width), c.area.bottomRight()),
-            Rectangle(c.area.topLeft(), Vec2(c.area.right(), c.area.bottom() - g.width))
-          };
-      case MarginType::LEFT: return {
-            Rectangle(c.area.topLeft(), Vec2(c.area.left() + g.width, c.area.bottom())),
-            Rectangle(Vec2(c.area.left() + g.width, c.area.top()), c.area.bottomRight())
-          };
-      case MarginType::RIGHT: return {
-            Rectangle(Vec2(c.area.right() - g.width, c.area.top()), c.area.bottomRight()),
-            Rectangle(c.area.topLeft(), Vec2(c.area.right() - g.width, c.area.bottom()))
-          };
-    }
-    fail();
-  }();
-  if (!g.border->make(c.with(rect.first), r))
+  auto areas = getMarginAreas(g, c.area);
+  if (!g.border->make(c.with(areas.first), r))
     return false;
-  return g.inside->make(c.with(rect.second), r);
+  return g.inside->make(c.with(areas.second), r);
+}
+
+pair<Rectangle, Rectangle> getSplitAreas(const LayoutGenerators::SplitH& g, Rectangle area) {
+  int split = int(area.left() + area.width() * g.r);
+  return make_pair(Rectangle(area.topLeft(), Vec2(split, area.bottom())),
+      Rectangle(Vec2(split, area.top()), area.bottomRight()));
+}
+
+pair<Rectangle, Rectangle> getSplitAreas(const LayoutGenerators::SplitV& g, Rectangle area) {
+  int split = int(area.top() + area.height() * g.r);
+  return make_pair(Rectangle(area.topLeft(), Vec2(area.right(), split)),
+      Rectangle(Vec2(area.left(), split), area.bottomRight()));
 }
 
 bool make(const LayoutGenerators::SplitH& g, LayoutCanvas c, RandomGen& r) {
-  if (!g.left->make(c.with(Rectangle(
-      c.area.topLeft(),
-      Vec2(int(c.area.left() + c.area.width() * g.r), c.area.bottom()))), r))
+  auto areas = getSplitAreas(g, c.area);
+  if (!g.left->make(c.with(areas.first), r))
     return false;
-  return g.right->make(c.with(Rectangle(
-      Vec2(int(c.area.left() + c.area.width() * g.r), c.area.top()),
-      c.area.bottomRight())), r);
+  return g.right->make(c.with(areas.second), r);
 }
 
 bool make(const LayoutGenerators::SplitV& g, LayoutCanvas c, RandomGen& r) {
-  if (!g.top->make(c.with(Rectangle(
-      c.area.topLeft(),
-      Vec2(c.area.right(), int(c.area.top() + c.area.height() * g.r)))), r))
+  auto areas = getSplitAreas(g, c.area);
+  if (!g.top->make(c.with(areas.first), r))
     return false;
-  return g.bottom->make(c.with(Rectangle(
-      Vec2(c.area.left(), int(c.area.top() + c.area.height() * g.r)),
-      c.area.bottomRight())), r);
+  return g.bottom->make(c.with(areas.second), r);
 }
 
-static Rectangle getPosition(PlacementPos pos, Rectangle area, Vec2 size, RandomGen& r) {
+static Rectangle getPosition(PlacementPos pos, Rectangle area, Vec2 size) {
   switch (pos) {
     case PlacementPos::MIDDLE:
       // - size / 2 + size is required due to integer rounding
@@ -149,7 +183,7 @@ static Vec2 chooseSize(optional<Vec2> size, optional<Vec2> minSize, optional<Vec
 }
 
 bool make(const LayoutGenerators::Position& g, LayoutCanvas c, RandomGen& r) {
-  auto pos = getPosition(g.position, c.area, chooseSize(g.size, g.minSize, g.maxSize, r), r);
+  auto pos = getPosition(g.position, c.area, chooseSize(g.size, g.minSize, g.maxSize, r));
   return g.generator->make(c.with(pos), r);
 }
 
@@ -165,13 +199,14 @@ void LayoutGenerators::Place::serialize(PrettyInputArchive& ar1, const unsigned
 }
 
 bool make(const LayoutGenerators::Place& g, LayoutCanvas c, RandomGen& r) {
-  vector<char> occupied(c.area.width() * c.area.height(), 0);
+  auto occupied = c.map->scratch.get<char>();
+  occupied->resize(c.area.width() * c.area.height());
   auto check = [&] (Rectangle rect, int spacing, const TilePredicate& p) {
     for (auto v : rect)
-      if (!p.apply(c.map, v, r) || occupied[(v.x - c.area.left()) + (v.y - c.area.top()) * c.area.width()] != 0)
+      if (!p.apply(c.map, v, r) || (*occupied)[(v.x - c.area.left()) + (v.y - c.area.top()) * c.area.width()] != 0)
         return false;
     for (auto v : rect.minusMargin(-spacing).intersection(c.area))
-      occupied[(v.x - c.area.left()) + (v.y - c.area.top()) * c.area.width()] = 1;
+      (*occupied)[(v.x - c.area.left()) + (v.y - c.area.top()) * c.area.width()] = 1;
     return true;
   };
   for (int i : All(g.generators)) {
@@ -180,6 +215,8 @@ bool make(const LayoutGenerators::Place& g, LayoutCanvas c, RandomGen& r) {
       CHECK(g.generators[i].size || (g.generators[i].minSize && g.generators[i].maxSize));
       const int numTries = 100000;
       for (int iter : Range(numTries)) {
+        if (c.map->profiler)
+          c.map->profiler->addAttempt();
         auto size = chooseSize(g.generators[i].size, g.generators[i].minSize, g.generators[i].maxSize, r);
         auto origin = Rectangle(c.area.topLeft(), c.area.bottomRight() - size + Vec2(1, 1)).random(r);
         Rectangle genArea(origin, origin + size);
@@ -200,28 +237,51 @@ bool make(const LayoutGenerators::Place& g, LayoutCanvas c, RandomGen& r) {
 bool make(const LayoutGenerators::NoiseMap& g, LayoutCanvas c, RandomGen& r) {
   if (c.area.empty())
     return true;
-  auto map = genNoiseMap(r, c.area, NoiseInit { 1, 1, 1, 1, 0 }, 0.45);
-  vector<double> all;
+  auto map = c.map->scratch.get<double>();
+  auto all = c.map->scratch.get<double>();
+  // Used for scratch space first, then for the sorted values.
+  genNoiseMap(r, c.area, NoiseInit { 1, 1, 1, 1, 0 }, 0.45, *map, *all);
   auto getValue = [&all](double r) {
-    int index = max(0, int(r * all.size()));
-    if (index >= all.size())
-      return all.back() + 1;
-    return all[index];
+    int index = max(0, int(r * all->size()));
+    if (index >= all->size())
+      return all->back() + 1;
+    return (*all)[index];
   };
-  for (auto v : map.getBounds())
-    all.push_back(map[v]);
-  sort(all.begin(), all.end());
+  *all = *map;
+  sort(all->begin(), all->end());
   for (auto& generator : g.generators) {
     auto lower = getValue(generator.lower);
     auto upper = getValue(generator.upper);
-    for (auto v : c.area)
-      if (map[v] >= lower && map[v] < upper)
+    int index = 0;
+    for (auto v : c.area) {
+      auto value = (*map)[index++];
+      if (value >= lower && value < upper)
         if (!generator.generator->make(c.with(Rectangle(v, v + Vec2(1, 1))), r))
           return false;
+    }
   }
   return true;
 }
 
+bool make(const LayoutGenerators::DistanceField& g, LayoutCanvas c, RandomGen& r) {
+  if (c.area.empty())
+    return true;
+  auto bounds = c.map->elems.getBounds();
+  auto sources = c.map->scratch.get<char>();
+  auto distances = c.map->scratch.get<double>();
+  for (auto v : bounds)
+    sources->push_back(g.from.apply(c.map, v, r));
+  genDistanceField(bounds, g.metric, *sources, *distances);
+  for (auto& band : g.bands)
+    for (auto v : c.area) {
+      auto distance = (*distances)[(v.x - bounds.left()) * bounds.height() + v.y - bounds.top()];
+      if (distance >= band.lower && distance < band.upper)
+        if (!band.generator->make(c.with(Rectangle(v, v + Vec2(1, 1))), r))
+          return false;
+    }
+  return true;
+}
+
 bool make(const LayoutGenerators::Chain& g, LayoutCanvas c, RandomGen& r) {
   for (auto& gen : g.generators)
     if (!gen.make(c, r))
@@ -237,21 +297,188 @@ bool make(const LayoutGenerators::Repeat& g, LayoutCanvas c, RandomGen& r) {
   return true;
 }
 
+bool make(const LayoutGenerators::Retry& g, LayoutCanvas c, RandomGen& r) {
+  for (int i : Range(g.count)) {
+    auto checkpoint = c.map->checkpoint();
+    if (g.generator->make(c, r)) {
+      c.map->commit(checkpoint);
+      c.map->failure = nullptr;
+      return true;
+    }
+    c.map->rollback(checkpoint);
+  }
+  return false;
+}
+
+bool make(const LayoutGenerators::Try& g, LayoutCanvas c, RandomGen& r) {
+  auto checkpoint = c.map->checkpoint();
+  if (g.generator->make(c, r))
+    c.map->commit(checkpoint);
+  else {
+    c.map->rollback(checkpoint);
+    c.map->failure = nullptr;
+  }
+  return true;
+}
+
+// True if running the generator on the area only writes tiles within bounds. Position with a size that doesn't fit
+// writes outside of its area, which a stamp can't reproduce. Covers the stampable generators, whose areas don't
+// depend on the random generator.
+static bool staysInside(const LayoutGenerator& g, Rectangle area, Rectangle bounds) {
+  auto writes = [&] { return area.empty() || bounds.contains(area); };
+  return g.visit<bool>(
+      [&](const LayoutGenerators::Set&) { return writes(); },
+      [&](const LayoutGenerators::SetFront&) { return writes(); },
+      [&](const LayoutGenerators::Reset&) { return writes(); },
+      [&](const LayoutGenerators::MarginImpl& g) {
+        auto areas = getMarginAreas(g, area);
+        return staysInside(*g.border, areas.first, bounds) && staysInside(*g.inside, areas.second, bounds); },
+      [&](const LayoutGenerators::Margins& g) {
+        for (auto& border : getBorderAreas(g, area))
+          if (!staysInside(*g.border, border, bounds))
+            return false;
+        return staysInside(*g.inside, area.minusMargin(g.width), bounds); },
+      [&](const LayoutGenerators::Position& g) {
+        return staysInside(*g.generator, getPosition(g.position, area, *g.size), bounds); },
+      [&](const LayoutGenerators::Chain& g) {
+        for (auto& gen : g.generators)
+          if (!staysInside(gen, area, bounds))
+            return false;
+        return true; },
+      [&](const LayoutGenerators::Retry& g) { return staysInside(*g.generator, area, bounds); },
+      [&](const LayoutGenerators::Try& g) { return staysInside(*g.generator, area, bounds); },
+      [&](const LayoutGenerators::Stamp& g) { return staysInside(*g.generator, area, bounds); },
+      [](const auto&) { return false; }
+  );
+}
+
+// Runs the generator on tiles that contain only a marker token. A tile without the marker was Reset, so its contents
+// don't depend on what was there before. Otherwise the tokens around the marker were added by Set and SetFront,
+// which only add tokens that the tile doesn't contain yet.
+static optional<Table<LayoutCanvas::Map::StampTile>> renderStamp(const LayoutGenerator& g, Vec2 size, RandomGen& r) {
+  if (!isStampable(g) || !staysInside(g, Rectangle(size), Rectangle(size)))
+    return none;
+  static const Token marker = "\x01";
+  LayoutCanvas::Map map(ChunkedTable<TokenList>(size.x, size.y, TokenList{marker}));
+  if (!g.make(LayoutCanvas{map.elems.getBounds(), &map}, r))
+    return none;
+  Table<LayoutCanvas::Map::StampTile> ret(size.x, size.y);
+  for (auto v : map.elems.getBounds()) {
+    auto& tile = map.elems[v];
+    auto& stampTile = ret[v];
+    int markerIndex = tile.size();
+    for (int i : All(tile))
+      if (tile[i] == marker)
+        markerIndex = i;
+    stampTile.replace = markerIndex == tile.size();
+    for (int i : All(tile))
+      if (stampTile.replace || i > markerIndex)
+        stampTile.back.push_back(tile[i]);
+      else if (i < markerIndex)
+        stampTile.front.push_back(tile[i]);
+  }
+  return std::move(ret);
+}
+
+bool make(const LayoutGenerators::Stamp& g, LayoutCanvas c, RandomGen& r) {
+  auto key = make_pair(&*g.generator, c.area.getSize());
+  auto it = c.map->stamps.find(key);
+  if (it == c.map->stamps.end())
+    it = c.map->stamps.insert(make_pair(key, renderStamp(*g.generator, key.second, r))).first;
+  if (!it->second)
+    return g.generator->make(c, r);
+  auto& stamp = *it->second;
+  for (auto v : c.area) {
+    auto& tile = stamp[v - c.area.topLeft()];
+    if (tile.replace)
+      c.map->modify(v) = tile.back;
+    else {
+      // In the reverse order, so that the first one ends up in front, as it was last pushed there.
+      for (int i = tile.front.size() - 1; i >= 0; --i)
+        if (!c.map->elems[v].contains(tile.front[i]))
+          c.map->modify(v).push_front(tile.front[i]);
+      for (auto& token : tile.back)
+        if (!c.map->elems[v].contains(token))
+          c.map->modify(v).push_back(token);
+    }
+  }
+  return true;
+}
+
+static Rectangle getFundamentalRegion(SymmetryMode mode, Rectangle area) {
+  auto halfSize = Vec2((area.width() + 1) / 2, (area.height() + 1) / 2);
+  switch (mode) {
+    case SymmetryMode::MIRROR_H:
+    case SymmetryMode::ROT180:
+      return Rectangle(area.topLeft(), Vec2(area.left() + halfSize.x, area.bottom()));
+    case SymmetryMode::MIRROR_V:
+      return Rectangle(area.topLeft(), Vec2(area.right(), area.top() + halfSize.y));
+    case SymmetryMode::ROT90:
+      return Rectangle(area.topLeft(), area.topLeft() + halfSize);
+  }
+  fail();
+}
+
+// The next tile in the orbit of v.
+static Vec2 getSymmetric(SymmetryMode mode, Rectangle area, Vec2 v) {
+  auto rel = v - area.topLeft();
+  auto last = area.getSize() - Vec2(1, 1);
+  switch (mode) {
+    case SymmetryMode::MIRROR_H:
+      return area.topLeft() + Vec2(last.x - rel.x, rel.y);
+    case SymmetryMode::MIRROR_V:
+      return area.topLeft() + Vec2(rel.x, last.y - rel.y);
+    case SymmetryMode::ROT180:
+      return area.topLeft() + last - rel;
+    case SymmetryMode::ROT90:
+      return area.topLeft() + Vec2(last.y - rel.y, rel.x);
+  }
+  fail();
+}
+
+bool make(const LayoutGenerators::Symmetric& g, LayoutCanvas c, RandomGen& r) {
+  if (g.mode == SymmetryMode::ROT90 && c.area.width() != c.area.height())
+    return false;
+  auto fundamental = getFundamentalRegion(g.mode, c.area);
+  if (!g.generator->make(c.with(fundamental), r))
+    return false;
+  for (auto v : c.area) {
+    // Some orbits have more than one tile in the fundamental region, the smallest one is the source.
+    optional<Vec2> source;
+    for (auto u = getSymmetric(g.mode, c.area, v); ; u = getSymmetric(g.mode, c.area, u)) {
+      if (u.inRectangle(fundamental) && (!source || u < *source))
+        source = u;
+      if (u == v)
+        break;
+    }
+    if (*source != v)
+      c.map->modify(v) = c.map->elems[*source];
+  }
+  return true;
+}
+
 bool make(const LayoutGenerators::Choose& g, LayoutCanvas c, RandomGen& r) {
-  vector<const LayoutGenerator*> generators;
+  CHECK(g.weights.empty() == g.generators.empty());
+  return g.generators[r.get(g.weights)].generator->make(c, r);
+}
+
+void LayoutGenerators::Choose::updateWeights() {
   double sumDefined = 0;
   int numUndefined = 0;
-  for (auto& elem : g.generators) {
-    generators.push_back(&*elem.generator);
+  for (auto& elem : generators)
     if (elem.chance)
       sumDefined += *elem.chance;
     else
       ++numUndefined;
-  }
   vector<double> chances;
-  for (auto& elem : g.generators)
+  for (auto& elem : generators)
     chances.push_back(elem.chance.value_or((1.0 - sumDefined) / numUndefined));
-  return r.choose(generators, chances)->make(c, r);
+  weights = CumulativeWeights(chances);
+}
+
+void LayoutGenerators::Choose::serialize(PrettyInputArchive& ar1, const unsigned int version) {
+  ar1(withRoundBrackets(generators));
+  updateWeights();
 }
 
 void LayoutGenerators::Connect::serialize(PrettyInputArchive& ar1, const unsigned int version) {
@@ -268,10 +495,21 @@ void LayoutGenerators::Connect::serialize(PrettyInputArchive& ar1, const unsigne
     ar1(t.generator);
     return t;
   };
-  if (!ar1.isOpenBracket(bracketType))
+  auto readSearch = [&] {
+    ar1.eat("search");
+    ar1.eat("=");
+    ar1(search);
+  };
+  if (!ar1.isOpenBracket(bracketType)) {
     elems.push_back(readElem());
-  else
+    if (ar1.eatMaybe(","))
+      readSearch();
+  } else
     while (!ar1.isCloseBracket(bracketType)) {
+      if (ar1.peek() == "search") {
+        readSearch();
+        continue;
+      }
       ar1.openBracket(bracketType);
       elems.push_back(readElem());
       ar1.closeBracket(bracketType);
@@ -289,15 +527,122 @@ const LayoutGenerators::Connect::Elem* getConnectorElem(const LayoutGenerators::
   return ret;
 }
 
-bool connect(const LayoutGenerators::Connect& g, LayoutCanvas c, RandomGen& r, Vec2 p1, Vec2 p2) {
-  ShortestPath path(c.area,
-      [&](Vec2 pos) {
-        auto elem = getConnectorElem(g, c, r, pos);
-        return !elem ? 1 : elem->cost.value_or(ShortestPath::infinity); },
-      [p2] (Vec2 to) { return p2.dist4(to); },
-      Vec2::directions4(), p1, p2);
-  for (Vec2 v = p2; v != p1; v = path.getNextMove(v)) {
-    if (auto elem = getConnectorElem(g, c, r, v)) {
+namespace {
+// The connector element and entry cost of every tile in the area, kept for a whole Connect pass, so that finding a
+// path doesn't evaluate any predicates. Tiles are computed again when a connector generator modifies a tile that
+// their predicates might read, and so is the path abstraction, if it was used. Only valid if the predicates don't
+// draw random numbers, see getConnectorCacheRadius.
+class ConnectorCache {
+  public:
+  ConnectorCache(const LayoutGenerators::Connect& g, LayoutCanvas c, RandomGen& r, int radius)
+      : g(g), c(c), r(r), radius(radius), elems(c.map->scratch.get<int>()), costs(c.map->scratch.get<double>()),
+        modified(c.map->scratch.get<Vec2>()), changedCosts(c.map->scratch.get<Vec2>()),
+        outerModified(c.map->modified) {
+    elems->resize(c.area.width() * c.area.height());
+    costs->resize(c.area.width() * c.area.height());
+    update(c.area);
+    c.map->modified = &*modified;
+  }
+
+  ConnectorCache(const ConnectorCache&) = delete;
+
+  ~ConnectorCache() {
+    c.map->modified = outerModified;
+    if (outerModified)
+      outerModified->append(*modified);
+  }
+
+  const LayoutGenerators::Connect::Elem* getElem(Vec2 v) {
+    refresh();
+    int index = (*elems)[getIndex(v)];
+    return index == 0 ? nullptr : &g.elems[index - 1];
+  }
+
+  const vector<double>& getCosts() {
+    refresh();
+    return *costs;
+  }
+
+  // Tiles whose cost changed are collected until the abstraction is needed again, since a path usually changes
+  // several tiles of every cluster that it crosses.
+  PathAbstraction& getAbstraction() {
+    refresh();
+    if (!abstraction)
+      abstraction.emplace(c.area, *costs);
+    else if (!changedCosts->empty()) {
+      abstraction->update(*changedCosts);
+      changedCosts->clear();
+    }
+    return *abstraction;
+  }
+
+  private:
+  int getIndex(Vec2 v) const {
+    return (v.x - c.area.left()) * c.area.height() + v.y - c.area.top();
+  }
+
+  void update(Rectangle area) {
+    for (int x = area.left(); x < area.right(); ++x)
+      for (int y = area.top(); y < area.bottom(); ++y) {
+        int index = getIndex(Vec2(x, y));
+        auto elem = getConnectorElem(g, c, r, Vec2(x, y));
+        double cost = !elem ? 1 : elem->cost.value_or(ShortestPath::infinity);
+        (*elems)[index] = elem ? elem - g.elems.data() + 1 : 0;
+        if (abstraction && cost != (*costs)[index])
+          changedCosts->push_back(Vec2(x, y));
+        (*costs)[index] = cost;
+      }
+  }
+
+  void refresh() {
+    if (modified->empty())
+      return;
+    for (auto v : *modified) {
+      auto area = Rectangle::centered(v, radius);
+      if (area.intersects(c.area))
+        update(area.intersection(c.area));
+    }
+    // A Connect that this one runs in still needs to see the tiles.
+    if (outerModified)
+      outerModified->append(*modified);
+    modified->clear();
+  }
+
+  const LayoutGenerators::Connect& g;
+  LayoutCanvas c;
+  RandomGen& r;
+  int radius;
+  // 0 means no element, otherwise the index of the element plus one.
+  ScratchBuffers::Lease<int> elems;
+  ScratchBuffers::Lease<double> costs;
+  ScratchBuffers::Lease<Vec2> modified;
+  ScratchBuffers::Lease<Vec2> changedCosts;
+  vector<Vec2>* outerModified;
+  optional<PathAbstraction> abstraction;
+};
+}
+
+// How far a modified tile can change the connector elements around it, or none if they can't be cached.
+static optional<int> getConnectorCacheRadius(const LayoutGenerators::Connect& g) {
+  int ret = 0;
+  for (auto& elem : g.elems) {
+    auto radius = getReadRadius(elem.predicate);
+    if (!radius || usesRandom(elem.predicate))
+      return none;
+    ret = max(ret, *radius);
+  }
+  return ret;
+}
+
+// Runs the connector generators along the path, starting from its end. An empty path means that the points aren't
+// connected, which fails the Connect whichever search found it.
+template <typename GetElem>
+static bool connectPath(LayoutCanvas c, RandomGen& r, const vector<Vec2>& path, GetElem getElem) {
+  if (path.empty())
+    return false;
+  for (int i = path.size() - 1; i > 0; --i) {
+    auto v = path[i];
+    if (auto elem = getElem(v)) {
       CHECK(!!elem->cost);
       if (!elem->generator->make(c.with(Rectangle(v, v + Vec2(1, 1))), r))
         return false;
@@ -306,28 +651,62 @@ bool connect(const LayoutGenerators::Connect& g, LayoutCanvas c, RandomGen& r, V
   return true;
 }
 
+static bool connect(const LayoutGenerators::Connect& g, LayoutCanvas c, RandomGen& r, Vec2 p1, Vec2 p2) {
+  if (c.map->profiler)
+    c.map->profiler->addAttempt();
+  ShortestPath path(c.area,
+      [&](Vec2 pos) {
+        auto elem = getConnectorElem(g, c, r, pos);
+        return !elem ? 1 : elem->cost.value_or(ShortestPath::infinity); },
+      [p2] (Vec2 to) { return p2.dist4(to); },
+      Vec2::directions4(), p1, p2);
+  return connectPath(c, r, path.getPath(), [&] (Vec2 v) { return getConnectorElem(g, c, r, v); });
+}
+
+static bool connect(const LayoutGenerators::Connect& g, ConnectorCache& cache, LayoutCanvas c, RandomGen& r,
+    Vec2 p1, Vec2 p2) {
+  if (c.map->profiler)
+    c.map->profiler->addAttempt();
+  auto getElem = [&] (Vec2 v) { return cache.getElem(v); };
+  if (g.search == ConnectSearch::HIERARCHICAL)
+    return connectPath(c, r, cache.getAbstraction().findPath(p1, p2), getElem);
+  ShortestPath path(c.area, cache.getCosts(), [p2] (Vec2 to) { return p2.dist4(to); }, Vec2::directions4(), p1, p2);
+  return connectPath(c, r, path.getPath(), getElem);
+}
+
+// HIERARCHICAL needs the cache, so Connects whose predicates can't be cached always search exactly.
 bool make(const LayoutGenerators::Connect& g, LayoutCanvas c, RandomGen& r) {
-  vector<Vec2> points = c.area.getAllSquares().filter(
-      [&](Vec2 v) { return g.toConnect.apply(c.map, v, r); });
-  Vec2 p1;
-  if (!points.empty())
-    for (int i : Range(300)) {
-      p1 = r.choose(points);
-      auto p2 = r.choose(points);
-      if (p1 != p2 && !connect(g, c, r, p1, p2))
-        return false;
-    }
+  auto points = c.map->scratch.get<Vec2>();
+  for (auto v : c.area)
+    if (g.toConnect.apply(c.map, v, r))
+      points->push_back(v);
+  if (points->empty())
+    return true;
+  optional<ConnectorCache> cache;
+  if (auto radius = getConnectorCacheRadius(g))
+    cache.emplace(g, c, r, *radius);
+  for (int i : Range(300)) {
+    auto p1 = r.choose(*points);
+    auto p2 = r.choose(*points);
+    if (p1 != p2 && !(cache ? connect(g, *cache, c, r, p1, p2) : connect(g, c, r, p1, p2)))
+      return false;
+  }
   return true;
 }
 
 bool make(const LayoutGenerators::FloodFill& g, LayoutCanvas c, RandomGen& r) {
-  queue<Vec2> q;
+  // The queue is never popped, tiles up to the index have been processed.
+  auto queue = c.map->scratch.get<Vec2>();
   auto wholeArea = c.map->elems.getBounds();
-  Table<bool> visited(wholeArea, false);
+  auto visited = c.map->scratch.get<char>();
+  visited->resize(wholeArea.width() * wholeArea.height());
   auto visit = [&](Vec2 v) {
-    if (v.inRectangle(wholeArea) && !visited[v] && g.predicate.apply(c.map, v, r)) {
-      visited[v] = true;
-      q.push(v);
+    if (!v.inRectangle(wholeArea))
+      return true;
+    auto& isVisited = (*visited)[(v.x - wholeArea.left()) * wholeArea.height() + v.y - wholeArea.top()];
+    if (!isVisited && g.predicate.apply(c.map, v, r)) {
+      isVisited = true;
+      queue->push_back(v);
       return g.generator->make(c.with(Rectangle(v, v + Vec2(1, 1))), r);
     }
     return true;
@@ -335,18 +714,53 @@ bool make(const LayoutGenerators::FloodFill& g, LayoutCanvas c, RandomGen& r) {
   for (auto v : c.area)
     if (!visit(v))
       return false;
-  while (!q.empty()) {
-    auto v = q.front();
-    q.pop();
-    for (auto neighbor : v.neighbors4())
-      if (!visit(neighbor))
+  for (int index = 0; index < queue->size(); ++index) {
+    auto v = (*queue)[index];
+    // In the order of Vec2::neighbors4, which allocates.
+    for (auto dir : {Vec2(0, 1), Vec2(1, 0), Vec2(0, -1), Vec2(-1, 0)})
+      if (!visit(v + dir))
         return false;
   }
   return true;
 }
 
 bool LayoutGenerator::make(LayoutCanvas c, RandomGen& r) const {
-  return visit<bool>([&c, &r] (const auto& g) { return ::make(g, c, r); } );
+  auto reroll = c.map->reroll;
+  int rerollCall = reroll ? reroll->enter(*this, c) : 0;
+  bool ret = false;
+  if (auto profiler = c.map->profiler) {
+    profiler->enter(*this, c.area);
+    ret = visit<bool>([&c, &r] (const auto& g) { return ::make(g, c, r); } );
+    profiler->exit();
+  } else
+    ret = visit<bool>([&c, &r] (const auto& g) { return ::make(g, c, r); } );
+  // Failures always propagate up, so the first node to record itself is where generation failed.
+  if (!ret && !c.map->failure)
+    c.map->failure = this;
+  if (reroll)
+    reroll->exit(rerollCall, c);
+  return ret;
+}
+
+string LayoutGenerator::getLabel(const vector<string>& filenames) const {
+  string ret = getName();
+  string positions;
+  for (auto& p : pos)
+    if (p.line > -1) {
+      if (!positions.empty())
+        positions += "<";
+      if (p.filename > -1 && p.filename < filenames.size())
+        positions += filenames[p.filename] + ":";
+      positions += toString(p.line) + ":" + toString<int>(p.column);
+    }
+  if (!positions.empty())
+    ret += "(" + positions + ")";
+  return ret;
+}
+
+void serialize(PrettyInputArchive& ar1, LayoutGenerator& g) {
+  g.pos = ar1.getPosition();
+  LayoutGenerators::serialize(ar1, g);
 }
 
 void LayoutGenerators::Choose::Elem::serialize(PrettyInputArchive& ar1, const unsigned int version) {
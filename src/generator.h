@@ -8,10 +8,10 @@
 struct LayoutGenerator;
 struct LayoutCanvas;
 
-using Token = string;
-
 RICH_ENUM(MarginType, TOP, BOTTOM, LEFT, RIGHT);
 RICH_ENUM(PlacementPos, MIDDLE, MIDDLE_V, MIDDLE_H, LEFT_CENTER, RIGHT_CENTER, TOP_CENTER, BOTTOM_CENTER);
+RICH_ENUM(SymmetryMode, MIRROR_H, MIRROR_V, ROT180, ROT90);
+RICH_ENUM(ConnectSearch, EXACT, HIERARCHICAL);
 
 namespace LayoutGenerators {
 
@@ -107,6 +107,22 @@ struct NoiseMap {
   SERIALIZE_ALL(withRoundBrackets(generators))
 };
 
+// Runs the generators on the tiles of the area whose distance to the nearest tile matching the predicate, anywhere
+// on the map, is at least lower and less than upper. The distances are computed once, before any generator runs,
+// in time linear in the size of the map.
+struct DistanceField {
+  struct Elem {
+    double SERIAL(lower);
+    double SERIAL(upper);
+    HeapAllocated<LayoutGenerator> SERIAL(generator);
+    SERIALIZE_ALL(roundBracket(), NAMED(lower), NAMED(upper), NAMED(generator))
+  };
+  TilePredicate SERIAL(from);
+  vector<Elem> SERIAL(bands);
+  DistanceMetric SERIAL(metric) = DistanceMetric::EUCLIDEAN;
+  SERIALIZE_ALL(roundBracket(), NAMED(from), NAMED(bands), OPTION(metric))
+};
+
 struct Chain {
   vector<LayoutGenerator> SERIAL(generators);
   SERIALIZE_ALL(generators)
@@ -122,6 +138,10 @@ struct Choose {
 
   vector<Elem> SERIAL(generators);
   SERIALIZE_ALL(withRoundBrackets(generators))
+  void serialize(PrettyInputArchive&, const unsigned int version);
+  // Must be called after changing the generators.
+  void updateWeights();
+  CumulativeWeights weights;
 };
 
 struct Connect {
@@ -133,7 +153,13 @@ struct Connect {
   };
   TilePredicate SERIAL(toConnect);
   vector<Elem> SERIAL(elems);
-  SERIALIZE_ALL(roundBracket(), NAMED(toConnect), NAMED(elems))
+  // HIERARCHICAL searches a cluster abstraction of the area, see PathAbstraction. Its corridors are near-optimal,
+  // so they differ from EXACT ones, but they are much faster to find on large maps. It doesn't fall back to EXACT
+  // where costs vary: distances within a cluster are exact for any costs, only the crossings between clusters are
+  // approximate. Written as a trailing "search = HIERARCHICAL" argument. With either search, points that can't be
+  // connected fail the Connect.
+  ConnectSearch SERIAL(search) = ConnectSearch::EXACT;
+  SERIALIZE_ALL(roundBracket(), NAMED(toConnect), NAMED(elems), OPTION(search))
   void serialize(PrettyInputArchive&, const unsigned int version);
 };
 
@@ -143,6 +169,35 @@ struct Repeat {
   SERIALIZE_ALL(roundBracket(), NAMED(count), NAMED(generator))
 };
 
+// Runs the generator up to count times, undoing the changes of every failed run.
+struct Retry {
+  int SERIAL(count);
+  HeapAllocated<LayoutGenerator> SERIAL(generator);
+  SERIALIZE_ALL(roundBracket(), NAMED(count), NAMED(generator))
+};
+
+// Runs the generator, and if it fails undoes its changes and carries on.
+struct Try {
+  HeapAllocated<LayoutGenerator> SERIAL(generator);
+  SERIALIZE_ALL(roundBracket(), NAMED(generator))
+};
+
+// Runs the generator once per area size and copies the result to every other area of the same size. Only used
+// for generators whose result doesn't depend on the position, and on the existing tiles only in that Set and
+// SetFront skip tokens that are already there, see isStampable.
+struct Stamp {
+  HeapAllocated<LayoutGenerator> SERIAL(generator);
+  SERIALIZE_ALL(roundBracket(), NAMED(generator))
+};
+
+// Runs the generator on the left half (MIRROR_H, ROT180), the top half (MIRROR_V) or the top left quarter (ROT90)
+// of the area, and copies the result to the symmetric tiles. ROT90 fails if the area isn't square.
+struct Symmetric {
+  SymmetryMode SERIAL(mode);
+  HeapAllocated<LayoutGenerator> SERIAL(generator);
+  SERIALIZE_ALL(roundBracket(), NAMED(mode), NAMED(generator))
+};
+
 struct FloodFill {
   TilePredicate SERIAL(predicate);
   HeapAllocated<LayoutGenerator> SERIAL(generator);
@@ -166,7 +221,12 @@ struct FloodFill {
   X(Connect, 13)\
   X(Choose, 14)\
   X(Repeat, 15)\
-  X(FloodFill, 16)
+  X(FloodFill, 16)\
+  X(Retry, 17)\
+  X(Try, 18)\
+  X(Stamp, 19)\
+  X(Symmetric, 20)\
+  X(DistanceField, 21)
 
 #define VARIANT_NAME GeneratorImpl
 
@@ -183,4 +243,14 @@ inline
 struct LayoutGenerator : LayoutGenerators::GeneratorImpl {
   using GeneratorImpl::GeneratorImpl;
   [[nodiscard]] bool make(LayoutCanvas, RandomGen&) const;
+  // Node name followed by where it was defined in the program, including the macro expansion stack.
+  string getLabel(const vector<string>& filenames) const;
+  // Where the node was defined in the program, used for profiling and failure reports.
+  StreamPosStack pos;
 };
+
+void serialize(PrettyInputArchive&, LayoutGenerator&);
+
+// The areas that the two children of a split are run on.
+pair<Rectangle, Rectangle> getSplitAreas(const LayoutGenerators::SplitH&, Rectangle);
+pair<Rectangle, Rectangle> getSplitAreas(const LayoutGenerators::SplitV&, Rectangle);
@@ -0,0 +1,210 @@
+#include "image_writer.h"
+
+static void appendBigEndian(string& s, unsigned value) {
+  for (int shift = 24; shift >= 0; shift -= 8)
+    s += char((value >> shift) & 0xff);
+}
+
+static unsigned getCrc(const string& data) {
+  static const auto table = [] {
+    array<unsigned, 256> ret;
+    for (unsigned i = 0; i < 256; ++i) {
+      unsigned c = i;
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      ret[i] = c;
+    }
+    return ret;
+  }();
+  unsigned crc = 0xffffffffu;
+  for (unsigned char c : data)
+    crc = table[(crc ^ c) & 0xff] ^ (crc >> 8);
+  return crc ^ 0xffffffffu;
+}
+
+ImageWriter::ImageWriter(const string& path, ImageFormat format, int width, int height)
+    : out(path, std::ios::binary), format(format), width(width), height(height) {
+  switch (format) {
+    case ImageFormat::PPM:
+      out << "P6\n" << width << " " << height << "\n255\n";
+      break;
+    case ImageFormat::PNG: {
+      out.write("\x89PNG\r\n\x1a\n", 8);
+      string header;
+      appendBigEndian(header, width);
+      appendBigEndian(header, height);
+      // 8 bits per channel, RGB, no interlacing.
+      header += string("\x08\x02\x00\x00\x00", 5);
+      writePngChunk("IHDR", header);
+      // The zlib header, followed by a single deflate block with fixed Huffman codes that ends in finish().
+      compressed += "\x78\x01";
+      writeBits(1, 1);
+      writeBits(1, 2);
+      break;
+    }
+  }
+}
+
+bool ImageWriter::good() const {
+  return out.good();
+}
+
+void ImageWriter::writePngChunk(const char* type, const string& data) {
+  string chunk(type);
+  chunk += data;
+  string length;
+  appendBigEndian(length, data.size());
+  string crc;
+  appendBigEndian(crc, getCrc(chunk));
+  out << length << chunk << crc;
+}
+
+void ImageWriter::writeBits(unsigned bits, int count) {
+  bitBuffer |= bits << bitCount;
+  bitCount += count;
+  while (bitCount >= 8) {
+    compressed += char(bitBuffer & 0xff);
+    bitBuffer >>= 8;
+    bitCount -= 8;
+  }
+}
+
+// Huffman codes are stored starting from the most significant bit.
+void ImageWriter::writeHuffmanCode(unsigned code, int length) {
+  unsigned reversed = 0;
+  for (int i = 0; i < length; ++i)
+    reversed |= ((code >> i) & 1) << (length - 1 - i);
+  writeBits(reversed, length);
+}
+
+// The fixed literal/length codes, see RFC 1951, section 3.2.6.
+static void getFixedCode(int symbol, unsigned& code, int& length) {
+  if (symbol < 144) {
+    code = 0x30 + symbol;
+    length = 8;
+  } else if (symbol < 256) {
+    code = 0x190 + symbol - 144;
+    length = 9;
+  } else if (symbol < 280) {
+    code = symbol - 256;
+    length = 7;
+  } else {
+    code = 0xc0 + symbol - 280;
+    length = 8;
+  }
+}
+
+void ImageWriter::writeLiteral(unsigned char c) {
+  unsigned code;
+  int length;
+  getFixedCode(c, code, length);
+  writeHuffmanCode(code, length);
+}
+
+void ImageWriter::writeMatch(int length, int distance) {
+  static const int lengthBase[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83,
+      99, 115, 131, 163, 195, 227, 258};
+  static const int lengthExtra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5,
+      5, 0};
+  static const int distanceBase[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+      1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+  static const int distanceExtra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11,
+      11, 12, 12, 13, 13};
+  int i = 28;
+  while (lengthBase[i] > length)
+    --i;
+  unsigned code;
+  int codeLength;
+  getFixedCode(257 + i, code, codeLength);
+  writeHuffmanCode(code, codeLength);
+  writeBits(length - lengthBase[i], lengthExtra[i]);
+  int j = 29;
+  while (distanceBase[j] > distance)
+    --j;
+  writeHuffmanCode(j, 5);
+  writeBits(distance - distanceBase[j], distanceExtra[j]);
+}
+
+// Deflate only allows distances up to 32768, so rows longer than that are only matched against their own previous
+// pixel.
+void ImageWriter::deflateRow(const vector<unsigned char>& row) {
+  const int maxDistance = 32768;
+  const int maxLength = 258;
+  int rowLength = row.size();
+  bool usePrevious = !previousRow.empty() && rowLength <= maxDistance;
+  auto getByte = [&] (int i) {
+    return i >= 0 ? row[i] : previousRow[rowLength + i];
+  };
+  auto getMatchLength = [&] (int pos, int distance) {
+    int ret = 0;
+    while (ret < maxLength && pos + ret < rowLength && row[pos + ret] == getByte(pos + ret - distance))
+      ++ret;
+    return ret;
+  };
+  for (int pos = 0; pos < rowLength;) {
+    int length = 0;
+    int distance = 0;
+    if (pos >= 3) {
+      length = getMatchLength(pos, 3);
+      distance = 3;
+    }
+    if (usePrevious && length < maxLength) {
+      int l = getMatchLength(pos, rowLength);
+      if (l > length) {
+        length = l;
+        distance = rowLength;
+      }
+    }
+    if (length >= 3) {
+      writeMatch(length, distance);
+      pos += length;
+    } else
+      writeLiteral(row[pos++]);
+  }
+  for (unsigned char c : row) {
+    adler1 = (adler1 + c) % 65521;
+    adler2 = (adler2 + adler1) % 65521;
+  }
+}
+
+void ImageWriter::flushCompressed() {
+  if (!compressed.empty()) {
+    writePngChunk("IDAT", compressed);
+    compressed.clear();
+  }
+}
+
+void ImageWriter::addRow(const vector<unsigned char>& row) {
+  CHECK(row.size() == width * 3 && numRows < height);
+  ++numRows;
+  switch (format) {
+    case ImageFormat::PPM:
+      out.write((const char*) row.data(), row.size());
+      break;
+    case ImageFormat::PNG:
+      // Every row starts with its filter type, which is always none.
+      currentRow.clear();
+      currentRow.push_back(0);
+      currentRow.append(row);
+      deflateRow(currentRow);
+      std::swap(previousRow, currentRow);
+      if (compressed.size() >= 1 << 16)
+        flushCompressed();
+      break;
+  }
+}
+
+bool ImageWriter::finish() {
+  CHECK(numRows == height);
+  if (format == ImageFormat::PNG) {
+    // The end of block code, then the Adler-32 checksum of the uncompressed data.
+    writeHuffmanCode(0, 7);
+    if (bitCount > 0)
+      writeBits(0, 8 - bitCount);
+    appendBigEndian(compressed, (adler2 << 16) | adler1);
+    flushCompressed();
+    writePngChunk("IEND", "");
+  }
+  out.close();
+  return !out.fail();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "stdafx.h"
+#include "util.h"
+
+RICH_ENUM(ImageFormat, PPM, PNG);
+
+// Writes an RGB image row by row, so that only the current row has to be kept in memory. PNGs are compressed with
+// a simple encoder that only looks for repeats of the previous pixel and of the row above, which is what maps
+// rendered at one color per tile consist of.
+class ImageWriter {
+  public:
+  // Check good() before use.
+  ImageWriter(const string& path, ImageFormat, int width, int height);
+  bool good() const;
+  // Takes width RGB triples. Rows are added top to bottom.
+  void addRow(const vector<unsigned char>&);
+  // Returns false if any write failed.
+  bool finish();
+
+  private:
+  void writePngChunk(const char* type, const string& data);
+  void writeBits(unsigned bits, int count);
+  void writeHuffmanCode(unsigned code, int length);
+  void writeLiteral(unsigned char);
+  void writeMatch(int length, int distance);
+  void deflateRow(const vector<unsigned char>& row);
+  void flushCompressed();
+  std::ofstream out;
+  ImageFormat format;
+  int width;
+  int height;
+  int numRows = 0;
+  // PNG only.
+  vector<unsigned char> previousRow;
+  vector<unsigned char> currentRow;
+  string compressed;
+  unsigned bitBuffer = 0;
+  int bitCount = 0;
+  unsigned adler1 = 1;
+  unsigned adler2 = 0;
+};
@@ -2,7 +2,14 @@
 #include "ProgramOptions.h"
 #include "canvas.h"
 #include "render.h"
-#include "umg_include.h"
+#include "printer.h"
+#include "profiler.h"
+#include "generation_driver.h"
+#include "reroll.h"
+#include "streaming.h"
+#include "map_file_writer.h"
+#include "map_file_reader.h"
+#include "umg.h"
 
 static po::parser getCommandLineFlags(int argc, char* argv[]) {
   po::parser flags;
@@ -10,6 +17,24 @@ static po::parser getCommandLineFlags(int argc, char* argv[]) {
   flags["seed"].type(po::i32).description("Random seed.");
   flags["render"].type(po::string).description("Path to file with glyph definitions.");
   flags["size"].type(po::i32).description("Size of the map.");
+  flags["dump-optimized"].description("Print the program after optimization and exit.");
+  flags["profile"].type(po::string).description("Write a per-node profiling report to this file.");
+  flags["profile-folded"].type(po::string).description("Write profiling call stacks for flamegraph.pl to this file.");
+  flags["attempts"].type(po::i32).fallback(1).description("Retry with derived seeds up to this many times.");
+  flags["time-budget"].type(po::i32).description("Don't start new attempts after this many milliseconds.");
+  flags["threads"].type(po::i32).fallback(1).description("Run attempts speculatively on this many threads.");
+  flags["reroll"].type(po::string).description("Regenerate the part of the map covering this area, given as x,y,w,h.");
+  flags["reroll-seed"].type(po::i32).description("Random seed for --reroll.");
+  flags["rng"].type(po::string).fallback("compatible").description("Random number engine: compatible or fast. "
+      "The fast one generates different maps for the same seed.");
+  flags["stream-output"].type(po::string).description("Generate the map one top-level split at a time and write it to "
+      "this file in the binary map format, without keeping the whole map in memory.");
+  flags["output-binary"].type(po::string).description("Write the map to this file in the binary map format.");
+  flags["bitplanes"].description("Include a bitplane per token in the binary map file.");
+  flags["image"].type(po::string).description("Draw the map to this .ppm or .png file, using the colors from the "
+      "file given by --render.");
+  flags["image-scale"].type(po::i32).fallback(1).description("Size of a tile in the image, in pixels.");
+  flags["print-binary"].type(po::string).description("Print the map stored in this binary map file and exit.");
   if (!flags.parseArgs(argc, argv))
     exit(-1);
   return flags;
@@ -24,28 +49,51 @@ static ifstream openFile(const string& path) {
   return in;
 }
 
-static LayoutGenerator readLayoutGenerator(const string& path) {
+static vector<string> getFilenames(const string& path) {
+  return {"include.umg", path};
+}
+
+static umg::Program readProgram(const string& path) {
   stringstream ss;
   ss << openFile(path).rdbuf();
-  string input = ss.str();
-  LayoutGenerator gen;
-  PrettyInputArchive ar({string(umgInclude), input}, {"include.umg", path}, nullptr);
   try {
-    ar(gen);
+    return umg::compile({ss.str()}, {path});
   } catch (PrettyException& ex) {
     std::cout << ex.text << "\n";
     exit(-1);
   }
-  return gen;
 }
 
-static LayoutCanvas::Map generateMap(const LayoutGenerator& gen, int size, RandomGen& random) {
-  LayoutCanvas::Map map{Table<vector<Token>>(size, size)};
-  if (!gen.make(LayoutCanvas{map.elems.getBounds(), &map}, random)) {
-    std::cout << "Generation failed.\n";
-    exit(-1);
+static GenerationBudget getBudget(po::parser& flags) {
+  GenerationBudget ret;
+  ret.maxAttempts = max(1, flags["attempts"].get().i32);
+  if (flags["time-budget"].was_set())
+    ret.time = milliseconds(flags["time-budget"].get().i32);
+  ret.threads = max(1, flags["threads"].get().i32);
+  return ret;
+}
+
+static void printAttempts(const GenerationResult& result, const vector<string>& filenames) {
+  for (auto& attempt : result.attempts)
+    if (!attempt.success) {
+      std::cerr << "Attempt " << attempt.index + 1 << " (seed " << attempt.seed << ") failed";
+      if (attempt.failure)
+        std::cerr << " in " << attempt.failure->getLabel(filenames);
+      std::cerr << " after " << attempt.time.count() << " ms.\n";
+    }
+  if (result.attempts.size() > 1 || !result.map)
+    std::cerr << (result.map ? "Succeeded" : "Failed") << " after " << result.attempts.size() << " attempts.\n";
+}
+
+static void writeProfile(po::parser& flags, const Profiler& profiler, const vector<string>& filenames) {
+  if (flags["profile"].was_set()) {
+    ofstream out(flags["profile"].get().string);
+    profiler.printReport(out, filenames);
+  }
+  if (flags["profile-folded"].was_set()) {
+    ofstream out(flags["profile-folded"].get().string);
+    profiler.printFoldedStacks(out, filenames);
   }
-  return map;
 }
 
 static string getInputPath(po::parser& flags) {
@@ -62,57 +110,249 @@ static int getMapSize(po::parser& flags) {
   return 10;
 }
 
-static RandomGen getRNG(po::parser& flags) {
-  RandomGen random;
-  int seed = int(time(nullptr));
+static RandomEngine getRandomEngine(po::parser& flags) {
+  auto name = flags["rng"].get().string;
+  if (name == "fast")
+    return RandomEngine::FAST;
+  if (name != "compatible") {
+    std::cout << "Unknown random number engine: " << name << "\n";
+    exit(-1);
+  }
+  return RandomEngine::COMPATIBLE;
+}
+
+static int getSeed(po::parser& flags) {
   if (flags["seed"].was_set())
-    seed = flags["seed"].get().i32;
-  random.init(seed);
-  return random;
+    return flags["seed"].get().i32;
+  return int(time(nullptr));
+}
+
+static int generateStreaming(const LayoutGenerator& gen, int size, int seed, RandomEngine engine, const string& path,
+    bool bitplanes) {
+  auto bands = getStreamingBands(gen, Rectangle(size, size));
+  if (!bands) {
+    std::cout << "The program can't be streamed. Its top level must be a tree of SplitH and SplitV nodes, over parts "
+        "that don't read tiles outside of their area.\n";
+    return -1;
+  }
+  MapFileWriter writer(path, Vec2(size, size), bitplanes);
+  if (!writer.good()) {
+    std::cout << "Failed to open file: " << path << "\n";
+    return -1;
+  }
+  if (auto error = generateStreaming(*bands, Vec2(size, size), seed, engine, writer)) {
+    std::cout << *error << "\n";
+    std::remove(path.c_str());
+    return -1;
+  }
+  return 0;
+}
+
+static bool writeBinary(const LayoutCanvas::Map& map, const string& path, bool bitplanes) {
+  MapFileWriter writer(path, map.elems.getBounds().getSize(), bitplanes);
+  if (writer.good()) {
+    writer.addBand(map.elems, map.elems.getBounds());
+    if (writer.finish())
+      return true;
+  }
+  std::cout << "Failed to write file: " << path << "\n";
+  return false;
+}
+
+static ImageFormat getImageFormat(const string& path) {
+  auto extension = path.substr(path.find_last_of('.') == string::npos ? path.size() : path.find_last_of('.'));
+  if (extension == ".png")
+    return ImageFormat::PNG;
+  if (extension == ".ppm")
+    return ImageFormat::PPM;
+  std::cout << "Image file must end with .png or .ppm: " << path << "\n";
+  exit(-1);
+}
+
+static int printBinary(const string& path) {
+  MapFileReader reader(path.c_str());
+  if (!reader.good()) {
+    std::cout << "Not a valid map file: " << path << "\n";
+    return -1;
+  }
+  vector<string> names;
+  for (int i : Range(reader.getNumTokens()))
+    names.push_back(string(reader.getTokenName(i)));
+  for (int x : Range(reader.getWidth()))
+    for (int y : Range(reader.getHeight())) {
+      for (auto id : reader.getTile(x, y))
+        std::cout << names[id] << ", ";
+      std::cout << "\n";
+    }
+  return 0;
+}
+
+static Rectangle getRerollArea(po::parser& flags, int size) {
+  auto values = split(flags["reroll"].get().string, {','});
+  optional<Rectangle> ret;
+  if (values.size() == 4)
+    try {
+      ret = Rectangle(Vec2(stoi(values[0]), stoi(values[1])), Vec2(stoi(values[0]) + stoi(values[2]),
+          stoi(values[1]) + stoi(values[3])));
+    } catch (std::logic_error&) {}
+  if (!ret || ret->empty() || !Rectangle(size, size).contains(*ret)) {
+    std::cout << "Bad reroll area: " << flags["reroll"].get().string << "\n";
+    exit(-1);
+  }
+  return *ret;
+}
+
+static int getRerollSeed(po::parser& flags) {
+  if (flags["reroll-seed"].was_set())
+    return flags["reroll-seed"].get().i32;
+  return int(time(nullptr)) + 1;
 }
 
 static milliseconds getRealMillis() {
   return duration_cast<milliseconds>(steady_clock::now().time_since_epoch());
 }
 
-extern "C" {
-const char* get_result(char* input, char* renderer, int size, int seed) {
-  RandomGen random;
-  if (seed == 0)
-    seed = getRealMillis().count();
-  random.init(seed);
-  LayoutGenerator gen;
-  PrettyInputArchive ar({string(umgInclude), string(input)}, {}, nullptr);
-  auto get_error = [] (const string& s) {
-    return (new string("<font color=red>" + s + "</font>"))->c_str();
-  };
-  if (size < 1 || size > 30)
-    return get_error("Bad map size: " + to_string(size));
+// Copies the string to the caller's buffer, truncated to fit and always null terminated. Returns its full length,
+// so that the caller can retry with a larger buffer.
+static int writeToBuffer(const string& s, char* buffer, int capacity) {
+  if (capacity > 0) {
+    int length = min<int>(s.size(), capacity - 1);
+    memcpy(buffer, s.data(), length);
+    buffer[length] = 0;
+  }
+  return s.size();
+}
+
+// What the web API hands out: the compiled program and a context that is reused for every map made from it.
+struct ProgramHandle {
+  umg::Program program;
+  umg::GenerationContext context;
+};
+
+static ProgramHandle* compileProgram(const char* program, string& error) {
   try {
-    ar(gen);
+    return new ProgramHandle{umg::compile({string(program)}), {}};
   } catch (PrettyException& ex) {
-    return get_error(ex.text);
+    error = ex.text;
+    return nullptr;
+  }
+}
+
+// Returns the map rendered as HTML, or none with the error.
+static optional<string> generateHtml(ProgramHandle& handle, const char* renderer, int width, int height,
+    int seed, string& error) {
+  if (width < 1 || height < 1) {
+    error = "Bad map size: " + to_string(width) + "x" + to_string(height);
+    return none;
   }
-  LayoutCanvas::Map map{Table<vector<Token>>(size, size)};
-  if (!gen.make(LayoutCanvas{map.elems.getBounds(), &map}, random)) {
-    return get_error("Generation failed.");
+  if (!umg::generate(handle.program, handle.context, width, height, seed == 0 ? getRealMillis().count() : seed)) {
+    error = "Generation failed.";
+    return none;
   }
-  return (new string(renderHtml(map, renderer)))->c_str();
+  return renderHtml(handle.context.getMap(), renderer);
+}
+
+extern "C" {
+// Returns null if the program doesn't compile, with the error written to the buffer.
+ProgramHandle* compile_program(const char* program, char* error, int errorCapacity) {
+  string message;
+  auto ret = compileProgram(program, message);
+  if (!ret)
+    writeToBuffer(message, error, errorCapacity);
+  return ret;
+}
+
+// Generates a map and writes it to the buffer as HTML, using the glyph definitions from renderer. Returns the full
+// length of the HTML, which was truncated if it's not less than the capacity. Returns -1 if generation failed, with
+// the error written to the buffer. A seed of 0 is replaced with the current time.
+int generate_map(ProgramHandle* program, const char* renderer, int width, int height, int seed,
+    char* buffer, int capacity) {
+  string error;
+  if (auto html = generateHtml(*program, renderer, width, height, seed, error))
+    return writeToBuffer(*html, buffer, capacity);
+  writeToBuffer(error, buffer, capacity);
+  return -1;
+}
+
+// Releases the program and the memory of the maps made from it.
+void free_program(ProgramHandle* program) {
+  delete program;
+}
+
+// Compiles and generates in one call. The result stays valid until the next call.
+const char* get_result(char* input, char* renderer, int size, int seed) {
+  static string result;
+  string error;
+  unique_ptr<ProgramHandle> program(compileProgram(input, error));
+  optional<string> html;
+  if (program)
+    html = generateHtml(*program, renderer, size, size, seed, error);
+  result = html ? std::move(*html) : "<font color=red>" + error + "</font>";
+  return result.c_str();
 }
 }
 
 int main(int argc, char* argv[]) {
   po::parser flags = getCommandLineFlags(argc, argv);
-  auto gen = readLayoutGenerator(getInputPath(flags));
+  if (flags["print-binary"].was_set())
+    return printBinary(flags["print-binary"].get().string);
+  auto path = getInputPath(flags);
+  auto program = readProgram(path);
+  auto& gen = program.getGenerator();
+  if (flags["dump-optimized"].was_set()) {
+    std::cout << gen << "\n";
+    return 0;
+  }
   int size = getMapSize(flags);
-  auto random = getRNG(flags);
-  auto map1 = generateMap(gen, size, random);
-  if (flags["render"].was_set()) {
+  auto engine = getRandomEngine(flags);
+  if (flags["stream-output"].was_set())
+    return generateStreaming(gen, size, getSeed(flags), engine, flags["stream-output"].get().string,
+        flags["bitplanes"].was_set());
+  bool profile = flags["profile"].was_set() || flags["profile-folded"].was_set();
+  Profiler profiler;
+  optional<Reroll> reroll;
+  if (flags["reroll"].was_set())
+    reroll.emplace(getRerollArea(flags, size));
+  auto result = generateWithRetries(gen, Vec2(size, size), getSeed(flags), engine, getBudget(flags),
+      profile ? &profiler : nullptr, reroll ? &*reroll : nullptr);
+  if (profile)
+    writeProfile(flags, profiler, getFilenames(path));
+  printAttempts(result, getFilenames(path));
+  auto& map1 = result.map;
+  if (!map1) {
+    std::cout << "Generation failed.\n";
+    return -1;
+  }
+  if (reroll) {
+    if (!reroll->getGenerator() || !reroll->apply(*map1, getRerollSeed(flags), engine)) {
+      std::cout << "Reroll failed.\n";
+      return -1;
+    }
+    auto area = reroll->getArea();
+    std::cerr << "Rerolled " << reroll->getGenerator()->getLabel(getFilenames(path)) << " at " << area.left() << ","
+        << area.top() << "," << area.width() << "," << area.height() << ".\n";
+  }
+  if (flags["output-binary"].was_set()) {
+    if (!writeBinary(*map1, flags["output-binary"].get().string, flags["bitplanes"].was_set()))
+      return -1;
+  }
+  if (flags["image"].was_set()) {
+    if (!flags["render"].was_set()) {
+      std::cout << "--image needs the glyph definitions given by --render.\n";
+      return -1;
+    }
+    auto path = flags["image"].get().string;
+    auto file = openFile(flags["render"].get().string);
+    if (!renderImage(*map1, file, path, getImageFormat(path), max(1, flags["image-scale"].get().i32))) {
+      std::cout << "Failed to write file: " << path << "\n";
+      return -1;
+    }
+  } else if (flags["render"].was_set()) {
     auto file = openFile(flags["render"].get().string);
-    renderAscii(map1, file);
-  } else
-    for (auto v : map1.elems.getBounds()) {
-      for (auto t : map1.elems[v])
+    renderAscii(*map1, file);
+  } else if (!flags["output-binary"].was_set())
+    for (auto v : map1->elems.getBounds()) {
+      for (auto t : map1->elems[v])
         std::cout << t << ", ";
       std::cout << "\n";
     }
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Binary map format. All integers are little-endian, the writer byte swaps them on big-endian hosts.
+//
+// The file starts with a MapFileHeader. The map is split into bands, which are rectangles that cover it without
+// overlapping. The data of each band is (width * height + 1) uint32 offsets followed by the uint32 token ids of all
+// its tiles, so that the ids of a tile are ids[offsets[i]] up to ids[offsets[i + 1]]. Tiles are numbered column by
+// column: i = (x - band.x) * band.height + (y - band.y).
+//
+// The band table is an array of numBands MapFileBands, at most mapFileMaxBands. The token dictionary is numTokens
+// entries of a uint32 length followed by that many characters, in id order.
+//
+// The band table and the bitplanes start at multiples of 8 bytes, so that a memory mapped file can be used in place
+// on little-endian hosts.
+//
+// Bitplanes are optional and kept per band, so that a streamed map can be written one band at a time. If a band's
+// bitplanesOffset isn't 0, it has numBitplanes bitplanes in id order, each made of (width * height + 63) / 64 uint64
+// words, where bit i is set if tile i of the band contains the token. Tokens with higher ids don't appear in the band.
+
+inline bool isLittleEndianHost() {
+  const uint16_t one = 1;
+  char first;
+  memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+const char mapFileMagic[4] = {'U', 'M', 'G', 'M'};
+const uint32_t mapFileVersion = 3;
+// Keeps the grid that the reader builds from the band edges small.
+const uint32_t mapFileMaxBands = 1024;
+
+struct MapFileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t numBands;
+  uint32_t numTokens;
+  uint64_t bandsOffset;
+  uint64_t tokensOffset;
+};
+
+struct MapFileBand {
+  int32_t x;
+  int32_t y;
+  int32_t width;
+  int32_t height;
+  uint64_t offset;
+  uint64_t bitplanesOffset;
+  uint32_t numBitplanes;
+  uint32_t padding;
+};
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "map_file.h"
+
+// Header-only reader for the format described in map_file.h. The file is memory mapped, and tiles are read straight
+// from the mapping without copying or decoding anything. Because of that big-endian hosts can't read the files.
+// Opening the file only checks the header, the band table and the token names, so it doesn't depend on the size of
+// the map. The tile data is bounds checked when it's read, and a corrupt tile reads as empty.
+class MapFileReader {
+  public:
+  // Check good() before use.
+  explicit MapFileReader(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+        data = (const char*) mapped;
+        size = st.st_size;
+      }
+    }
+    close(fd);
+    if (data && !validate()) {
+      munmap((void*) data, size);
+      data = nullptr;
+    }
+  }
+
+  ~MapFileReader() {
+    if (data)
+      munmap((void*) data, size);
+  }
+
+  MapFileReader(const MapFileReader&) = delete;
+  MapFileReader& operator = (const MapFileReader&) = delete;
+
+  // False if the file couldn't be opened or isn't a valid map file of this version, or the host is big-endian.
+  bool good() const {
+    return !!data;
+  }
+
+  int getWidth() const {
+    return getHeader().width;
+  }
+
+  int getHeight() const {
+    return getHeader().height;
+  }
+
+  int getNumTokens() const {
+    return getHeader().numTokens;
+  }
+
+  // The name of the token with the given id, empty if there is no such token.
+  std::string_view getTokenName(uint32_t id) const {
+    if (id >= tokenOffsets.size())
+      return {};
+    const char* pos = data + tokenOffsets[id];
+    uint32_t length;
+    memcpy(&length, pos, sizeof(length));
+    return std::string_view(pos + sizeof(length), length);
+  }
+
+  // Returns the id of the token with the given name, or -1 if it doesn't appear in the map.
+  int64_t findToken(std::string_view name) const {
+    for (uint32_t i = 0; i < getHeader().numTokens; ++i)
+      if (getTokenName(i) == name)
+        return i;
+    return -1;
+  }
+
+  struct Tile {
+    const uint32_t* first;
+    const uint32_t* last;
+    const uint32_t* begin() const { return first; }
+    const uint32_t* end() const { return last; }
+    size_t size() const { return last - first; }
+  };
+
+  // The token ids of the tile, bottom one first. Empty if the position is outside of the map. The ids of a corrupt
+  // file may not be less than getNumTokens().
+  Tile getTile(int x, int y) const {
+    auto band = getBand(x, y);
+    if (!band)
+      return Tile{nullptr, nullptr};
+    auto offsets = (const uint32_t*) (data + band->offset);
+    auto numTiles = uint64_t(band->width) * band->height;
+    auto ids = offsets + numTiles + 1;
+    auto index = uint64_t(x - band->x) * band->height + (y - band->y);
+    if (offsets[index] > offsets[index + 1] || offsets[index + 1] > offsets[numTiles])
+      return Tile{nullptr, nullptr};
+    return Tile{ids + offsets[index], ids + offsets[index + 1]};
+  }
+
+  // The writer adds bitplanes to all bands or to none.
+  bool hasBitplanes() const {
+    return getBands()[0].bitplanesOffset != 0;
+  }
+
+  // Uses the bitplane of the token if there is one, otherwise looks through the tile.
+  bool contains(int x, int y, uint32_t id) const {
+    auto band = getBand(x, y);
+    if (!band)
+      return false;
+    if (band->bitplanesOffset != 0) {
+      if (id >= band->numBitplanes)
+        return false;
+      auto plane = (const uint64_t*) (data + band->bitplanesOffset) + id * getNumWords(*band);
+      auto bit = uint64_t(x - band->x) * band->height + (y - band->y);
+      return (plane[bit / 64] >> (bit % 64)) & 1;
+    }
+    for (auto tileId : getTile(x, y))
+      if (tileId == id)
+        return true;
+    return false;
+  }
+
+  private:
+  const MapFileHeader& getHeader() const {
+    return *(const MapFileHeader*) data;
+  }
+
+  const MapFileBand* getBands() const {
+    return (const MapFileBand*) (data + getHeader().bandsOffset);
+  }
+
+  // Null if the position is outside of the map.
+  const MapFileBand* getBand(int x, int y) const {
+    if (x < 0 || y < 0 || x >= getWidth() || y >= getHeight())
+      return nullptr;
+    auto column = std::upper_bound(columns.begin(), columns.end(), x) - columns.begin() - 1;
+    auto row = std::upper_bound(rows.begin(), rows.end(), y) - rows.begin() - 1;
+    auto index = cells[column * (rows.size() - 1) + row];
+    if (index >= getHeader().numBands)
+      return nullptr;
+    return &getBands()[index];
+  }
+
+  // The edges of all bands split the map into a grid of cells, each of which is inside a single band.
+  static std::vector<int32_t> getEdges(const MapFileBand* bands, uint32_t numBands, bool vertical) {
+    std::vector<int32_t> ret;
+    for (uint32_t i = 0; i < numBands; ++i) {
+      ret.push_back(vertical ? bands[i].x : bands[i].y);
+      ret.push_back(vertical ? bands[i].x + bands[i].width : bands[i].y + bands[i].height);
+    }
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    return ret;
+  }
+
+  static uint64_t getNumWords(const MapFileBand& band) {
+    return (uint64_t(band.width) * band.height + 63) / 64;
+  }
+
+  bool isInFile(uint64_t offset, uint64_t length) const {
+    return offset <= size && length <= size - offset;
+  }
+
+  // Checks the layout of the file that the accessors rely on, so that a truncated or corrupt file can't make them
+  // read outside of the mapping. Also finds where the token names are and builds the band grid.
+  bool validate() {
+    if (!isLittleEndianHost() || size < sizeof(MapFileHeader))
+      return false;
+    auto& header = getHeader();
+    if (memcmp(header.magic, mapFileMagic, sizeof(mapFileMagic)) != 0 || header.version != mapFileVersion)
+      return false;
+    if (header.numBands == 0 || header.numBands > mapFileMaxBands || header.width == 0 || header.height == 0
+        || header.width > INT32_MAX || header.height > INT32_MAX || header.bandsOffset % 8 != 0
+        || !isInFile(header.bandsOffset, uint64_t(header.numBands) * sizeof(MapFileBand)))
+      return false;
+    auto bands = getBands();
+    for (uint32_t i = 0; i < header.numBands; ++i) {
+      auto& band = bands[i];
+      if (band.x < 0 || band.y < 0 || band.width <= 0 || band.height <= 0 || band.offset % 4 != 0
+          || uint64_t(band.x) + band.width > header.width || uint64_t(band.y) + band.height > header.height)
+        return false;
+      uint64_t numTiles = uint64_t(band.width) * band.height;
+      if (!isInFile(band.offset, (numTiles + 1) * sizeof(uint32_t)))
+        return false;
+      // The last offset is the number of ids in the band. The other ones are checked when a tile is read.
+      uint32_t numIds;
+      memcpy(&numIds, data + band.offset + numTiles * sizeof(uint32_t), sizeof(numIds));
+      if (!isInFile(band.offset + (numTiles + 1) * sizeof(uint32_t), uint64_t(numIds) * sizeof(uint32_t)))
+        return false;
+      if (band.bitplanesOffset != 0) {
+        if (!hasBitplanes() || band.bitplanesOffset % 8 != 0 || band.numBitplanes > header.numTokens
+            || !isInFile(band.bitplanesOffset, uint64_t(band.numBitplanes) * getNumWords(band) * sizeof(uint64_t)))
+          return false;
+      } else if (hasBitplanes())
+        return false;
+    }
+    // Every cell of the grid must be covered by exactly one band.
+    columns = getEdges(bands, header.numBands, true);
+    rows = getEdges(bands, header.numBands, false);
+    if (columns.front() != 0 || columns.back() != int32_t(header.width) || rows.front() != 0
+        || rows.back() != int32_t(header.height))
+      return false;
+    uint64_t numRows = rows.size() - 1;
+    cells.assign((columns.size() - 1) * numRows, header.numBands);
+    for (uint32_t i = 0; i < header.numBands; ++i) {
+      auto& band = bands[i];
+      auto firstColumn = std::lower_bound(columns.begin(), columns.end(), band.x) - columns.begin();
+      auto firstRow = std::lower_bound(rows.begin(), rows.end(), band.y) - rows.begin();
+      for (auto column = firstColumn; columns[column] < band.x + band.width; ++column)
+        for (auto row = firstRow; rows[row] < band.y + band.height; ++row) {
+          auto& cell = cells[column * numRows + row];
+          if (cell != header.numBands)
+            return false;
+          cell = i;
+        }
+    }
+    for (auto cell : cells)
+      if (cell == header.numBands)
+        return false;
+    uint64_t pos = header.tokensOffset;
+    for (uint32_t i = 0; i < header.numTokens; ++i) {
+      uint32_t length;
+      if (!isInFile(pos, sizeof(length)))
+        return false;
+      memcpy(&length, data + pos, sizeof(length));
+      if (!isInFile(pos + sizeof(length), length))
+        return false;
+      tokenOffsets.push_back(pos);
+      pos += sizeof(length) + length;
+    }
+    return true;
+  }
+
+  const char* data = nullptr;
+  uint64_t size = 0;
+  std::vector<uint64_t> tokenOffsets;
+  std::vector<int32_t> columns;
+  std::vector<int32_t> rows;
+  // The band of each cell of the grid, in x-major order.
+  std::vector<uint32_t> cells;
+};
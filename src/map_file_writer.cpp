@@ -0,0 +1,124 @@
+#include "map_file_writer.h"
+
+// The format is little-endian, so on big-endian hosts everything is byte swapped just before it's written.
+template <typename T>
+static T toLittleEndian(T value) {
+  if (isLittleEndianHost())
+    return value;
+  T ret;
+  auto from = (const char*) &value;
+  auto to = (char*) &ret;
+  for (int i = 0; i < sizeof(T); ++i)
+    to[i] = from[sizeof(T) - 1 - i];
+  return ret;
+}
+
+template <typename T>
+static void toLittleEndian(std::vector<T>& values) {
+  if (!isLittleEndianHost())
+    for (auto& value : values)
+      value = toLittleEndian(value);
+}
+
+static MapFileBand toLittleEndian(MapFileBand band) {
+  return MapFileBand{toLittleEndian(band.x), toLittleEndian(band.y), toLittleEndian(band.width),
+      toLittleEndian(band.height), toLittleEndian(band.offset), toLittleEndian(band.bitplanesOffset),
+      toLittleEndian(band.numBitplanes), 0};
+}
+
+static MapFileHeader toLittleEndian(MapFileHeader header) {
+  header.version = toLittleEndian(header.version);
+  header.width = toLittleEndian(header.width);
+  header.height = toLittleEndian(header.height);
+  header.numBands = toLittleEndian(header.numBands);
+  header.numTokens = toLittleEndian(header.numTokens);
+  header.bandsOffset = toLittleEndian(header.bandsOffset);
+  header.tokensOffset = toLittleEndian(header.tokensOffset);
+  return header;
+}
+
+MapFileWriter::MapFileWriter(const string& path, Vec2 size, bool bitplanes)
+    : out(path, std::ios::binary), size(size), withBitplanes(bitplanes) {
+  // Rewritten by finish(), once the offsets are known.
+  MapFileHeader header {};
+  out.write((const char*) &header, sizeof(header));
+}
+
+bool MapFileWriter::good() const {
+  return out.good();
+}
+
+uint32_t MapFileWriter::getTokenId(Token token) {
+  if (auto id = getReferenceMaybe(tokenIds, token))
+    return *id;
+  tokenIds[token] = tokens.size();
+  tokens.push_back(token);
+  return tokens.size() - 1;
+}
+
+void MapFileWriter::alignTo(int bytes) {
+  while (out.tellp() % bytes != 0)
+    out.put(0);
+}
+
+void MapFileWriter::addBand(const ChunkedTable<TokenList>& elems, Rectangle area) {
+  MapFileBand band {area.left(), area.top(), area.width(), area.height(), uint64_t(out.tellp()), 0, 0, 0};
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> ids;
+  offsets.reserve(area.width() * area.height() + 1);
+  for (auto v : area) {
+    offsets.push_back(ids.size());
+    for (auto& token : elems[v])
+      ids.push_back(getTokenId(token));
+  }
+  offsets.push_back(ids.size());
+  std::vector<uint64_t> bitplanes;
+  if (withBitplanes) {
+    size_t words = (size_t(area.width()) * area.height() + 63) / 64;
+    bitplanes.resize(tokens.size() * words);
+    for (int i = 0; i + 1 < offsets.size(); ++i)
+      for (auto j = offsets[i]; j < offsets[i + 1]; ++j)
+        bitplanes[ids[j] * words + i / 64] |= uint64_t(1) << (i % 64);
+  }
+  toLittleEndian(offsets);
+  toLittleEndian(ids);
+  out.write((const char*) offsets.data(), offsets.size() * sizeof(uint32_t));
+  out.write((const char*) ids.data(), ids.size() * sizeof(uint32_t));
+  if (withBitplanes) {
+    alignTo(8);
+    band.bitplanesOffset = out.tellp();
+    band.numBitplanes = tokens.size();
+    toLittleEndian(bitplanes);
+    out.write((const char*) bitplanes.data(), bitplanes.size() * sizeof(uint64_t));
+  }
+  bands.push_back(band);
+}
+
+bool MapFileWriter::finish() {
+  if (bands.size() > mapFileMaxBands)
+    return false;
+  MapFileHeader header {};
+  std::copy(std::begin(mapFileMagic), std::end(mapFileMagic), header.magic);
+  header.version = mapFileVersion;
+  header.width = size.x;
+  header.height = size.y;
+  header.numBands = bands.size();
+  header.numTokens = tokens.size();
+  alignTo(8);
+  header.bandsOffset = out.tellp();
+  for (auto& band : bands) {
+    auto written = toLittleEndian(band);
+    out.write((const char*) &written, sizeof(written));
+  }
+  header.tokensOffset = out.tellp();
+  for (auto& token : tokens) {
+    uint32_t length = toLittleEndian(uint32_t(token.getName().size()));
+    out.write((const char*) &length, sizeof(length));
+    out.write(token.getName().data(), token.getName().size());
+  }
+  out.seekp(0);
+  header = toLittleEndian(header);
+  out.write((const char*) &header, sizeof(header));
+  out.close();
+  return !out.fail();
+}
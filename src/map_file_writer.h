@@ -0,0 +1,29 @@
+#pragma once
+
+#include "stdafx.h"
+#include "util.h"
+#include "token.h"
+#include "map_file.h"
+
+// Writes a map in the format described in map_file.h. Bands are written as soon as they are added, so that a
+// caller generating the map piece by piece only needs to keep the current piece in memory.
+class MapFileWriter {
+  public:
+  // Check good() before use. Bitplanes take a bit per tile and token, and are written with every band.
+  MapFileWriter(const string& path, Vec2 size, bool bitplanes = false);
+  bool good() const;
+  void addBand(const ChunkedTable<TokenList>&, Rectangle area);
+  // Writes the band table and the token dictionary. Returns false if any write failed or there are more than
+  // mapFileMaxBands bands.
+  bool finish();
+
+  private:
+  uint32_t getTokenId(Token);
+  void alignTo(int bytes);
+  std::ofstream out;
+  Vec2 size;
+  vector<MapFileBand> bands;
+  vector<Token> tokens;
+  unordered_map<Token, uint32_t> tokenIds;
+  bool withBitplanes;
+};
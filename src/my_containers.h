@@ -3,6 +3,8 @@
 #include <vector>
 #include <set>
 #include <type_traits>
+#include <algorithm>
+#include <cstring>
 #include <initializer_list>
 #include <set>
 #include <unordered_set>
@@ -445,6 +447,175 @@ inline void serialize(Archive& ar1, vector<T>& v) {
 }
 
 
+// Keeps up to N elements inline and only allocates when it grows beyond that. T must be trivially copyable.
+template <typename T, int N>
+class small_vector {
+  public:
+  static_assert(std::is_trivially_copyable<T>::value, "T should be trivially copyable");
+
+  small_vector() {}
+
+  small_vector(initializer_list<T> elems) {
+    reserve(int(elems.size()));
+    for (auto& elem : elems)
+      push_back(elem);
+  }
+
+  small_vector(const small_vector& o) {
+    reserve(o.count);
+    std::memcpy((void*) data(), o.data(), o.count * sizeof(T));
+    count = o.count;
+  }
+
+  small_vector(small_vector&& o) noexcept {
+    steal(o);
+  }
+
+  small_vector& operator = (const small_vector& o) {
+    if (this != &o) {
+      count = 0;
+      reserve(o.count);
+      std::memcpy((void*) data(), o.data(), o.count * sizeof(T));
+      count = o.count;
+    }
+    return *this;
+  }
+
+  small_vector& operator = (small_vector&& o) noexcept {
+    if (this != &o) {
+      freeHeap();
+      steal(o);
+    }
+    return *this;
+  }
+
+  ~small_vector() {
+    freeHeap();
+  }
+
+  int size() const {
+    return count;
+  }
+
+  bool empty() const {
+    return count == 0;
+  }
+
+  T* data() {
+    return capacity > N ? heapElems : (T*) inlineElems;
+  }
+
+  const T* data() const {
+    return capacity > N ? heapElems : (const T*) inlineElems;
+  }
+
+  T& operator[] (int i) {
+    assert(i >= 0 && i < count);
+    return data()[i];
+  }
+
+  const T& operator[] (int i) const {
+    assert(i >= 0 && i < count);
+    return data()[i];
+  }
+
+  T* begin() {
+    return data();
+  }
+
+  T* end() {
+    return data() + count;
+  }
+
+  const T* begin() const {
+    return data();
+  }
+
+  const T* end() const {
+    return data() + count;
+  }
+
+  void reserve(int s) {
+    if (s <= capacity)
+      return;
+    auto newCapacity = std::max(s, 2 * capacity);
+    auto elems = (T*) ::operator new(newCapacity * sizeof(T));
+    std::memcpy((void*) elems, data(), count * sizeof(T));
+    freeHeap();
+    heapElems = elems;
+    capacity = newCapacity;
+  }
+
+  // The element is copied first, since it may be one of ours and move when the storage does.
+  void push_back(const T& t) {
+    T value = t;
+    if (count == capacity)
+      reserve(count + 1);
+    new (data() + count) T(value);
+    ++count;
+  }
+
+  void push_front(const T& t) {
+    T value = t;
+    if (count == capacity)
+      reserve(count + 1);
+    auto elems = data();
+    std::memmove((void*) (elems + 1), elems, count * sizeof(T));
+    new (elems) T(value);
+    ++count;
+  }
+
+  void clear() {
+    count = 0;
+  }
+
+  bool contains(const T& elem) const {
+    return std::find(begin(), end(), elem) != end();
+  }
+
+  bool removeElementMaybePreserveOrder(const T& elem) {
+    auto it = std::find(begin(), end(), elem);
+    if (it == end())
+      return false;
+    std::memmove((void*) it, it + 1, (end() - it - 1) * sizeof(T));
+    --count;
+    return true;
+  }
+
+  bool operator == (const small_vector& o) const {
+    return std::equal(begin(), end(), o.begin(), o.end());
+  }
+
+  bool operator != (const small_vector& o) const {
+    return !(*this == o);
+  }
+
+  private:
+  void freeHeap() {
+    if (capacity > N)
+      ::operator delete(heapElems);
+    capacity = N;
+  }
+
+  void steal(small_vector& o) {
+    if (o.capacity > N) {
+      heapElems = o.heapElems;
+      capacity = o.capacity;
+    } else
+      std::memcpy(inlineElems, o.inlineElems, o.count * sizeof(T));
+    count = o.count;
+    o.capacity = N;
+    o.count = 0;
+  }
+
+  int count = 0;
+  int capacity = N;
+  union {
+    alignas(T) char inlineElems[N * sizeof(T)];
+    T* heapElems;
+  };
+};
+
 template<class T>
 std::ostream& operator<<(std::ostream& d, const vector<T>& container){
   d << "{";
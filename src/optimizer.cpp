@@ -0,0 +1,636 @@
+#include "optimizer.h"
+#include "generator.h"
+
+static bool isTrue(const TilePredicate& p) {
+  return p.contains<TilePredicates::True>();
+}
+
+static bool isFalse(const TilePredicate& p) {
+  if (auto n = p.getReferenceMaybe<TilePredicates::Not>())
+    return isTrue(*n->predicate);
+  return false;
+}
+
+static TilePredicate getFalse() {
+  return TilePredicates::Not{TilePredicate(TilePredicates::True{})};
+}
+
+static bool usesRandom(const vector<TilePredicate>& predicates) {
+  for (auto& p : predicates)
+    if (usesRandom(p))
+      return true;
+  return false;
+}
+
+bool usesRandom(const TilePredicate& p) {
+  return p.visit<bool>(
+      [](const TilePredicates::Chance&) { return true; },
+      [](const TilePredicates::Not& p) { return usesRandom(*p.predicate); },
+      [](const TilePredicates::Area& p) { return usesRandom(*p.predicate); },
+      [](const TilePredicates::Distance& p) { return usesRandom(*p.predicate); },
+      [](const TilePredicates::And& p) { return usesRandom(p.predicates); },
+      [](const TilePredicates::Or& p) { return usesRandom(p.predicates); },
+      [](const auto&) { return false; }
+  );
+}
+
+bool usesRandom(const LayoutGenerator& g) {
+  return g.visit<bool>(
+      [](const LayoutGenerators::Set&) { return false; },
+      [](const LayoutGenerators::SetFront&) { return false; },
+      [](const LayoutGenerators::Reset&) { return false; },
+      [](const LayoutGenerators::Remove&) { return false; },
+      [](const LayoutGenerators::Filter& g) {
+        return usesRandom(g.predicate) || usesRandom(*g.generator) || (g.alt && usesRandom(*g.alt)); },
+      [](const LayoutGenerators::MarginImpl& g) { return usesRandom(*g.border) || usesRandom(*g.inside); },
+      [](const LayoutGenerators::Margins& g) { return usesRandom(*g.border) || usesRandom(*g.inside); },
+      [](const LayoutGenerators::SplitH& g) { return usesRandom(*g.left) || usesRandom(*g.right); },
+      [](const LayoutGenerators::SplitV& g) { return usesRandom(*g.top) || usesRandom(*g.bottom); },
+      [](const LayoutGenerators::Position& g) { return !g.size || usesRandom(*g.generator); },
+      [](const LayoutGenerators::Chain& g) {
+        for (auto& gen : g.generators)
+          if (usesRandom(gen))
+            return true;
+        return false; },
+      [](const LayoutGenerators::FloodFill& g) { return usesRandom(g.predicate) || usesRandom(*g.generator); },
+      [](const LayoutGenerators::Stamp& g) { return usesRandom(*g.generator); },
+      [](const LayoutGenerators::Symmetric& g) { return usesRandom(*g.generator); },
+      [](const LayoutGenerators::DistanceField& g) {
+        if (usesRandom(g.from))
+          return true;
+        for (auto& band : g.bands)
+          if (usesRandom(*band.generator))
+            return true;
+        return false; },
+      [](const auto&) { return true; }
+  );
+}
+
+// True if the node neither draws random numbers nor modifies the map when run on an empty area.
+static bool isInertOnEmptyArea(const LayoutGenerator& g) {
+  return g.visit<bool>(
+      [](const LayoutGenerators::MarginImpl& g) {
+        return isInertOnEmptyArea(*g.border) && isInertOnEmptyArea(*g.inside); },
+      [](const LayoutGenerators::Margins& g) {
+        return isInertOnEmptyArea(*g.border) && isInertOnEmptyArea(*g.inside); },
+      [](const LayoutGenerators::SplitH& g) { return isInertOnEmptyArea(*g.left) && isInertOnEmptyArea(*g.right); },
+      [](const LayoutGenerators::SplitV& g) { return isInertOnEmptyArea(*g.top) && isInertOnEmptyArea(*g.bottom); },
+      [](const LayoutGenerators::Chain& g) {
+        for (auto& gen : g.generators)
+          if (!isInertOnEmptyArea(gen))
+            return false;
+        return true; },
+      [](const LayoutGenerators::Position&) { return false; },
+      [](const LayoutGenerators::Place&) { return false; },
+      [](const LayoutGenerators::Choose&) { return false; },
+      [](const LayoutGenerators::Repeat&) { return false; },
+      [](const LayoutGenerators::Retry& g) { return g.count > 0 && isInertOnEmptyArea(*g.generator); },
+      [](const LayoutGenerators::Try& g) { return isInertOnEmptyArea(*g.generator); },
+      [](const LayoutGenerators::Stamp& g) { return isInertOnEmptyArea(*g.generator); },
+      [](const LayoutGenerators::Symmetric& g) {
+        return g.mode != SymmetryMode::ROT90 && isInertOnEmptyArea(*g.generator); },
+      [](const auto&) { return true; }
+  );
+}
+
+// True if the node has no effect at all, on any area.
+static bool isNoOp(const LayoutGenerator& g) {
+  return g.visit<bool>(
+      [](const LayoutGenerators::Chain& g) { return g.generators.empty(); },
+      [](const LayoutGenerators::Set& g) { return g.tokens.empty(); },
+      [](const LayoutGenerators::Remove& g) { return g.tokens.empty(); },
+      [](const auto&) { return false; }
+  );
+}
+
+static bool isWrite(const LayoutGenerator& g) {
+  return g.contains<LayoutGenerators::Set>() || g.contains<LayoutGenerators::SetFront>() ||
+      g.contains<LayoutGenerators::Reset>() || g.contains<LayoutGenerators::Remove>();
+}
+
+// True if running the node on an area gives the same result as running it on every tile of the area in turn,
+// which is what Filter does.
+static bool isTileWise(const LayoutGenerator& g) {
+  if (isWrite(g) || g.contains<LayoutGenerators::Filter>())
+    return true;
+  if (auto chain = g.getReferenceMaybe<LayoutGenerators::Chain>()) {
+    for (auto& gen : chain->generators)
+      if (!isWrite(gen))
+        return false;
+    return true;
+  }
+  return false;
+}
+
+// Remove is left out because it only writes tiles that contain its tokens, and SplitH and SplitV because rounding
+// of the split position depends on where the area is. A Position that is larger than the stamped area is run
+// directly instead, since it writes outside of it.
+bool isStampable(const LayoutGenerator& g) {
+  return g.visit<bool>(
+      [](const LayoutGenerators::Set&) { return true; },
+      [](const LayoutGenerators::SetFront&) { return true; },
+      [](const LayoutGenerators::Reset&) { return true; },
+      [](const LayoutGenerators::MarginImpl& g) { return isStampable(*g.border) && isStampable(*g.inside); },
+      [](const LayoutGenerators::Margins& g) { return isStampable(*g.border) && isStampable(*g.inside); },
+      [](const LayoutGenerators::Position& g) { return g.size && isStampable(*g.generator); },
+      [](const LayoutGenerators::Chain& g) {
+        for (auto& gen : g.generators)
+          if (!isStampable(gen))
+            return false;
+        return true; },
+      [](const LayoutGenerators::Retry& g) { return isStampable(*g.generator); },
+      [](const LayoutGenerators::Try& g) { return isStampable(*g.generator); },
+      [](const LayoutGenerators::Stamp& g) { return isStampable(*g.generator); },
+      [](const auto&) { return false; }
+  );
+}
+
+// Area and Distance are left out because they read other tiles. With outside set, the tile itself may be outside
+// of the area and On is left out too.
+static bool isLocal(const TilePredicate& p, bool outside) {
+  return p.visit<bool>(
+      [&](const TilePredicates::On&) { return !outside; },
+      [&](const TilePredicates::Not& p) { return isLocal(*p.predicate, outside); },
+      [&](const TilePredicates::And& p) {
+        for (auto& pred : p.predicates)
+          if (!isLocal(pred, outside))
+            return false;
+        return true; },
+      [&](const TilePredicates::Or& p) {
+        for (auto& pred : p.predicates)
+          if (!isLocal(pred, outside))
+            return false;
+        return true; },
+      [](const TilePredicates::Area&) { return false; },
+      [](const TilePredicates::Distance&) { return false; },
+      [](const auto&) { return true; }
+  );
+}
+
+static optional<int> getReadRadius(const vector<TilePredicate>& predicates) {
+  int ret = 0;
+  for (auto& p : predicates)
+    if (auto radius = getReadRadius(p))
+      ret = max(ret, *radius);
+    else
+      return none;
+  return ret;
+}
+
+optional<int> getReadRadius(const TilePredicate& p) {
+  return p.visit<optional<int>>(
+      [](const TilePredicates::Not& p) { return getReadRadius(*p.predicate); },
+      [](const TilePredicates::And& p) { return getReadRadius(p.predicates); },
+      [](const TilePredicates::Or& p) { return getReadRadius(p.predicates); },
+      [](const TilePredicates::Area& p) -> optional<int> {
+        if (auto radius = getReadRadius(*p.predicate))
+          return *radius + p.radius;
+        return none; },
+      [](const TilePredicates::Distance&) -> optional<int> { return none; },
+      [](const auto&) -> optional<int> { return 0; }
+  );
+}
+
+// FloodFill is left out because it spreads over the whole map, and DistanceField because it reads all of it.
+// Position runs its generator on an area larger than its own when the chosen size doesn't fit, so below it the
+// tiles outside of the area can't be read or cleared. Writing to them is only caught when streaming.
+static bool isLocal(const LayoutGenerator& g, bool outside) {
+  return g.visit<bool>(
+      [](const LayoutGenerators::Set&) { return true; },
+      [](const LayoutGenerators::SetFront&) { return true; },
+      [&](const LayoutGenerators::Reset& g) { return !outside || !g.tokens.empty(); },
+      [&](const LayoutGenerators::Remove&) { return !outside; },
+      [&](const LayoutGenerators::Filter& g) {
+        return isLocal(g.predicate, outside) && isLocal(*g.generator, outside) &&
+            (!g.alt || isLocal(*g.alt, outside)); },
+      [&](const LayoutGenerators::MarginImpl& g) { return isLocal(*g.border, outside) && isLocal(*g.inside, outside); },
+      [&](const LayoutGenerators::Margins& g) { return isLocal(*g.border, outside) && isLocal(*g.inside, outside); },
+      [&](const LayoutGenerators::SplitH& g) { return isLocal(*g.left, outside) && isLocal(*g.right, outside); },
+      [&](const LayoutGenerators::SplitV& g) { return isLocal(*g.top, outside) && isLocal(*g.bottom, outside); },
+      [&](const LayoutGenerators::Position& g) { return isLocal(*g.generator, true); },
+      [&](const LayoutGenerators::Place& g) {
+        for (auto& elem : g.generators)
+          if (!isLocal(elem.predicate, outside) || !isLocal(*elem.generator, outside))
+            return false;
+        return true; },
+      [&](const LayoutGenerators::NoiseMap& g) {
+        for (auto& elem : g.generators)
+          if (!isLocal(*elem.generator, outside))
+            return false;
+        return true; },
+      [&](const LayoutGenerators::Chain& g) {
+        for (auto& gen : g.generators)
+          if (!isLocal(gen, outside))
+            return false;
+        return true; },
+      [&](const LayoutGenerators::Connect& g) {
+        if (!isLocal(g.toConnect, outside))
+          return false;
+        for (auto& elem : g.elems)
+          if (!isLocal(elem.predicate, outside) || !isLocal(*elem.generator, outside))
+            return false;
+        return true; },
+      [&](const LayoutGenerators::Choose& g) {
+        for (auto& elem : g.generators)
+          if (!isLocal(*elem.generator, outside))
+            return false;
+        return true; },
+      [&](const LayoutGenerators::Repeat& g) { return isLocal(*g.generator, outside); },
+      [&](const LayoutGenerators::Retry& g) { return isLocal(*g.generator, outside); },
+      [&](const LayoutGenerators::Try& g) { return isLocal(*g.generator, outside); },
+      [&](const LayoutGenerators::Stamp& g) { return isLocal(*g.generator, outside); },
+      [&](const LayoutGenerators::Symmetric& g) { return !outside && isLocal(*g.generator, outside); },
+      [](const auto&) { return false; }
+  );
+}
+
+bool isLocal(const LayoutGenerator& g) {
+  return isLocal(g, false);
+}
+
+static LayoutGenerator getNoOp() {
+  return LayoutGenerators::Chain{};
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::Set& g) {
+  return g;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::SetFront& g) {
+  return g;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::Reset& g) {
+  return g;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::Remove& g) {
+  return g;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::Filter& g) {
+  LayoutGenerators::Filter ret{optimize(g.predicate), optimize(*g.generator), {}};
+  if (g.alt)
+    ret.alt = optimize(*g.alt);
+  if (isFalse(ret.predicate)) {
+    if (!ret.alt)
+      return getNoOp();
+    ret.predicate = TilePredicates::True{};
+    ret.generator = HeapAllocated<LayoutGenerator>(std::move(*ret.alt));
+    ret.alt.clear();
+  }
+  if (isTrue(ret.predicate)) {
+    ret.alt.clear();
+    if (isTileWise(*ret.generator))
+      return *ret.generator;
+  }
+  if (isNoOp(*ret.generator) && (!ret.alt || isNoOp(*ret.alt)) && !usesRandom(ret.predicate))
+    return getNoOp();
+  return ret;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::MarginImpl& g) {
+  LayoutGenerators::MarginImpl ret{g.type, g.width, optimize(*g.border), optimize(*g.inside)};
+  if (ret.width == 0 && isInertOnEmptyArea(*ret.border))
+    return *ret.inside;
+  if (isNoOp(*ret.border) && isNoOp(*ret.inside))
+    return getNoOp();
+  return ret;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::Margins& g) {
+  LayoutGenerators::Margins ret{g.width, optimize(*g.border), optimize(*g.inside)};
+  if (ret.width == 0 && isInertOnEmptyArea(*ret.border))
+    return *ret.inside;
+  if (isNoOp(*ret.border) && isNoOp(*ret.inside))
+    return getNoOp();
+  return ret;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::SplitH& g) {
+  LayoutGenerators::SplitH ret{g.r, optimize(*g.left), optimize(*g.right)};
+  if (isNoOp(*ret.left) && isNoOp(*ret.right))
+    return getNoOp();
+  return ret;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::SplitV& g) {
+  LayoutGenerators::SplitV ret{g.r, optimize(*g.top), optimize(*g.bottom)};
+  if (isNoOp(*ret.top) && isNoOp(*ret.bottom))
+    return getNoOp();
+  return ret;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::Position& g) {
+  auto ret = g;
+  ret.generator = optimize(*g.generator);
+  if (ret.size && isNoOp(*ret.generator))
+    return getNoOp();
+  return ret;
+}
+
+// Place usually runs its generators many times with only a few different sizes.
+static LayoutGenerator optimize(const LayoutGenerators::Place& g) {
+  auto ret = g;
+  for (auto& elem : ret.generators) {
+    elem.generator = optimize(*elem.generator);
+    auto& gen = *elem.generator;
+    if (isStampable(gen) && !isWrite(gen) && !isNoOp(gen) && !gen.contains<LayoutGenerators::Stamp>())
+      elem.generator = LayoutGenerators::Stamp{gen};
+    elem.predicate = optimize(elem.predicate);
+  }
+  return ret;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::NoiseMap& g) {
+  auto ret = g;
+  for (auto& elem : ret.generators)
+    elem.generator = optimize(*elem.generator);
+  return ret;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::DistanceField& g) {
+  auto ret = g;
+  ret.from = optimize(g.from);
+  bool noOp = !usesRandom(ret.from);
+  for (auto& band : ret.bands) {
+    band.generator = optimize(*band.generator);
+    noOp &= isNoOp(*band.generator);
+  }
+  if (noOp)
+    return getNoOp();
+  return ret;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::Chain& g) {
+  LayoutGenerators::Chain ret;
+  for (auto& gen : g.generators) {
+    auto opt = optimize(gen);
+    if (auto chain = opt.getReferenceMaybe<LayoutGenerators::Chain>())
+      ret.generators.append(chain->generators);
+    else if (!isNoOp(opt))
+      ret.generators.push_back(std::move(opt));
+  }
+  if (ret.generators.size() == 1)
+    return ret.generators[0];
+  return ret;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::Connect& g) {
+  auto ret = g;
+  ret.toConnect = optimize(g.toConnect);
+  for (auto& elem : ret.elems) {
+    elem.predicate = optimize(elem.predicate);
+    elem.generator = optimize(*elem.generator);
+  }
+  return ret;
+}
+
+// Elements with zero chance are never chosen. Removing them doesn't change the sum of the weights, so the
+// random draw maps to the same element. A single remaining element is kept under Choose because the draw
+// still has to happen.
+static LayoutGenerator optimize(const LayoutGenerators::Choose& g) {
+  LayoutGenerators::Choose ret;
+  for (auto& elem : g.generators)
+    if (!elem.chance || *elem.chance != 0)
+      ret.generators.push_back(LayoutGenerators::Choose::Elem{elem.chance, optimize(*elem.generator)});
+  if (ret.generators.empty())
+    return g;
+  ret.updateWeights();
+  return ret;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::Repeat& g) {
+  return LayoutGenerators::Repeat{g.count, optimize(*g.generator)};
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::Retry& g) {
+  LayoutGenerators::Retry ret{g.count, optimize(*g.generator)};
+  if (g.count > 0 && isNoOp(*ret.generator))
+    return getNoOp();
+  return ret;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::Try& g) {
+  LayoutGenerators::Try ret{optimize(*g.generator)};
+  if (isNoOp(*ret.generator))
+    return getNoOp();
+  return ret;
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::Stamp& g) {
+  LayoutGenerator inside = optimize(*g.generator);
+  if (isNoOp(inside) || isWrite(inside) || inside.contains<LayoutGenerators::Stamp>())
+    return inside;
+  return LayoutGenerators::Stamp{std::move(inside)};
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::Symmetric& g) {
+  return LayoutGenerators::Symmetric{g.mode, optimize(*g.generator)};
+}
+
+static LayoutGenerator optimize(const LayoutGenerators::FloodFill& g) {
+  LayoutGenerators::FloodFill ret{optimize(g.predicate), optimize(*g.generator)};
+  if (isNoOp(*ret.generator) && !usesRandom(ret.predicate))
+    return getNoOp();
+  return ret;
+}
+
+LayoutGenerator optimize(const LayoutGenerator& g) {
+  auto ret = g.visit<LayoutGenerator>([](const auto& g) { return ::optimize(g); });
+  if (ret.pos[0].line == -1)
+    ret.pos = g.pos;
+  return ret;
+}
+
+static TilePredicate optimize(const TilePredicates::On& p) {
+  return p;
+}
+
+static TilePredicate optimize(const TilePredicates::Not& p) {
+  auto inside = optimize(*p.predicate);
+  if (auto n = inside.getReferenceMaybe<TilePredicates::Not>())
+    return *n->predicate;
+  return TilePredicates::Not{std::move(inside)};
+}
+
+static TilePredicate optimize(const TilePredicates::True& p) {
+  return p;
+}
+
+// Predicates are evaluated left to right until the result is known, so anything after a constant that decides
+// the result can be dropped. The whole expression can only be folded to a constant if nothing before it draws
+// random numbers.
+template <typename Type>
+static TilePredicate optimizeShortCircuit(const vector<TilePredicate>& predicates, bool decidingValue) {
+  auto isDeciding = [&](const TilePredicate& p) { return decidingValue ? isTrue(p) : isFalse(p); };
+  auto isNeutral = [&](const TilePredicate& p) { return decidingValue ? isFalse(p) : isTrue(p); };
+  auto getConstant = [](bool value) { return value ? TilePredicate(TilePredicates::True{}) : getFalse(); };
+  Type ret;
+  bool deterministic = true;
+  auto finish = [&] {
+    if (ret.predicates.empty())
+      return getConstant(!decidingValue);
+    if (ret.predicates.size() == 1)
+      return ret.predicates[0];
+    return TilePredicate(ret);
+  };
+  for (auto& pred : predicates) {
+    auto opt = optimize(pred);
+    auto nested = opt.template getReferenceMaybe<Type>();
+    for (auto& elem : nested ? nested->predicates : vector<TilePredicate>{opt}) {
+      if (isNeutral(elem))
+        continue;
+      if (isDeciding(elem)) {
+        if (deterministic)
+          return getConstant(decidingValue);
+        ret.predicates.push_back(elem);
+        return finish();
+      }
+      deterministic &= !usesRandom(elem);
+      ret.predicates.push_back(elem);
+    }
+  }
+  return finish();
+}
+
+static TilePredicate optimize(const TilePredicates::And& p) {
+  return optimizeShortCircuit<TilePredicates::And>(p.predicates, false);
+}
+
+static TilePredicate optimize(const TilePredicates::Or& p) {
+  return optimizeShortCircuit<TilePredicates::Or>(p.predicates, true);
+}
+
+static TilePredicate optimize(const TilePredicates::Chance& p) {
+  return p;
+}
+
+static TilePredicate optimize(const TilePredicates::Area& p) {
+  TilePredicates::Area ret{p.radius, optimize(*p.predicate), p.minCount};
+  if (ret.minCount <= 0 && !usesRandom(*ret.predicate))
+    return TilePredicates::True{};
+  return ret;
+}
+
+static TilePredicate optimize(const TilePredicates::Distance& p) {
+  return TilePredicates::Distance{p.min, p.max, optimize(*p.predicate), p.metric};
+}
+
+static TilePredicate optimize(const TilePredicates::XMod& p) {
+  return p;
+}
+
+static TilePredicate optimize(const TilePredicates::YMod& p) {
+  return p;
+}
+
+TilePredicate optimize(const TilePredicate& p) {
+  return p.visit<TilePredicate>([](const auto& p) { return ::optimize(p); });
+}
+
+static void moveNodesToArena(TilePredicate&, Arena&);
+static void moveNodesToArena(LayoutGenerator&, Arena&);
+
+// Each node is moved before its children, so they end up in depth-first order.
+template <typename T>
+static void moveNodesToArena(HeapAllocated<T>& node, Arena& arena) {
+  node.moveToArena(arena);
+  moveNodesToArena(*node, arena);
+}
+
+static void moveNodesToArena(heap_optional<LayoutGenerator>& node, Arena& arena) {
+  node.moveToArena(arena);
+  if (node)
+    moveNodesToArena(*node, arena);
+}
+
+static void moveNodesToArena(TilePredicate& p, Arena& arena) {
+  p.visit(
+      [&](TilePredicates::Not& p) { moveNodesToArena(p.predicate, arena); },
+      [&](TilePredicates::And& p) {
+        for (auto& pred : p.predicates)
+          moveNodesToArena(pred, arena);
+      },
+      [&](TilePredicates::Or& p) {
+        for (auto& pred : p.predicates)
+          moveNodesToArena(pred, arena);
+      },
+      [&](TilePredicates::Area& p) { moveNodesToArena(p.predicate, arena); },
+      [&](TilePredicates::Distance& p) { moveNodesToArena(p.predicate, arena); },
+      [](auto&) {}
+  );
+}
+
+static void moveNodesToArena(LayoutGenerator& g, Arena& arena) {
+  g.visit(
+      [&](LayoutGenerators::Filter& g) {
+        moveNodesToArena(g.predicate, arena);
+        moveNodesToArena(g.generator, arena);
+        moveNodesToArena(g.alt, arena);
+      },
+      [&](LayoutGenerators::MarginImpl& g) {
+        moveNodesToArena(g.border, arena);
+        moveNodesToArena(g.inside, arena);
+      },
+      [&](LayoutGenerators::Margins& g) {
+        moveNodesToArena(g.border, arena);
+        moveNodesToArena(g.inside, arena);
+      },
+      [&](LayoutGenerators::SplitH& g) {
+        moveNodesToArena(g.left, arena);
+        moveNodesToArena(g.right, arena);
+      },
+      [&](LayoutGenerators::SplitV& g) {
+        moveNodesToArena(g.top, arena);
+        moveNodesToArena(g.bottom, arena);
+      },
+      [&](LayoutGenerators::Position& g) { moveNodesToArena(g.generator, arena); },
+      [&](LayoutGenerators::Place& g) {
+        for (auto& elem : g.generators) {
+          moveNodesToArena(elem.generator, arena);
+          moveNodesToArena(elem.predicate, arena);
+        }
+      },
+      [&](LayoutGenerators::NoiseMap& g) {
+        for (auto& elem : g.generators)
+          moveNodesToArena(elem.generator, arena);
+      },
+      [&](LayoutGenerators::DistanceField& g) {
+        moveNodesToArena(g.from, arena);
+        for (auto& band : g.bands)
+          moveNodesToArena(band.generator, arena);
+      },
+      [&](LayoutGenerators::Chain& g) {
+        for (auto& gen : g.generators)
+          moveNodesToArena(gen, arena);
+      },
+      [&](LayoutGenerators::Choose& g) {
+        for (auto& elem : g.generators)
+          moveNodesToArena(elem.generator, arena);
+      },
+      [&](LayoutGenerators::Connect& g) {
+        moveNodesToArena(g.toConnect, arena);
+        for (auto& elem : g.elems) {
+          moveNodesToArena(elem.predicate, arena);
+          moveNodesToArena(elem.generator, arena);
+        }
+      },
+      [&](LayoutGenerators::Repeat& g) { moveNodesToArena(g.generator, arena); },
+      [&](LayoutGenerators::Retry& g) { moveNodesToArena(g.generator, arena); },
+      [&](LayoutGenerators::Try& g) { moveNodesToArena(g.generator, arena); },
+      [&](LayoutGenerators::Stamp& g) { moveNodesToArena(g.generator, arena); },
+      [&](LayoutGenerators::Symmetric& g) { moveNodesToArena(g.generator, arena); },
+      [&](LayoutGenerators::FloodFill& g) {
+        moveNodesToArena(g.predicate, arena);
+        moveNodesToArena(g.generator, arena);
+      },
+      [](auto&) {}
+  );
+}
+
+LayoutGenerator optimize(const LayoutGenerator& g, Arena& arena) {
+  auto ret = optimize(g);
+  moveNodesToArena(ret, arena);
+  return ret;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "stdafx.h"
+
+struct LayoutGenerator;
+struct TilePredicate;
+class Arena;
+
+// Simplifies a parsed program. The rewrites never change the generated map or the sequence of random numbers
+// drawn for a given seed, so the optimized program is a drop-in replacement for the original one.
+LayoutGenerator optimize(const LayoutGenerator&);
+TilePredicate optimize(const TilePredicate&);
+
+// Also moves the nodes of the optimized program into the arena, in depth-first order, so that generation walks them
+// in the order they are laid out. The arena must outlive the returned program, and nodes copied from it are on the
+// heap.
+LayoutGenerator optimize(const LayoutGenerator&, Arena&);
+
+// Conservative: returns true for every node that might draw from the RandomGen.
+bool usesRandom(const LayoutGenerator&);
+bool usesRandom(const TilePredicate&);
+
+// How far from the tile the predicate may read other tiles, or none if there is no bound.
+optional<int> getReadRadius(const TilePredicate&);
+
+// True if the node's result doesn't depend on the position of its area, on the existing tiles where it writes (except
+// that Set and SetFront skip tokens that are already there), or on anything outside its area, so that it can be
+// wrapped in Stamp.
+bool isStampable(const LayoutGenerator&);
+
+// True if the node doesn't read any tiles outside its area, so that the tiles outside don't affect its result.
+bool isLocal(const LayoutGenerator&);
@@ -0,0 +1,278 @@
+#include "path_abstraction.h"
+#include "shortest_path.h"
+
+// Open stretches of border shorter than this get a single transition in the middle, longer ones one at each end.
+const int maxSingleTransitionLength = 6;
+
+static int getLocalIndex(const Rectangle& r, Vec2 v) {
+  return (v.x - r.left()) * r.height() + v.y - r.top();
+}
+
+static Vec2 getLocalPosition(const Rectangle& r, int index) {
+  return Vec2(r.left() + index / r.height(), r.top() + index % r.height());
+}
+
+PathAbstraction::PathAbstraction(Rectangle area, const vector<double>& costs, int clusterSize)
+    : area(area), costs(costs), clusterSize(clusterSize),
+      numClustersX((area.width() + clusterSize - 1) / clusterSize),
+      numClustersY((area.height() + clusterSize - 1) / clusterSize) {
+  CHECK(costs.size() == area.width() * area.height());
+  nodeIndex.resize(costs.size());
+  for (auto& index : nodeIndex)
+    index = -1;
+  minCost = ShortestPath::infinity;
+  for (auto cost : costs)
+    minCost = min(minCost, max(0.0, cost));
+  for (int x : Range(numClustersX))
+    for (int y : Range(numClustersY)) {
+      auto corner = area.topLeft() + Vec2(x, y) * clusterSize;
+      auto clusterArea = Rectangle(corner, corner + Vec2(clusterSize, clusterSize)).intersection(area);
+      clusters.push_back(Cluster{clusterArea, {}, {}});
+    }
+  for (auto& cluster : clusters)
+    updateNodes(cluster);
+  for (auto& cluster : clusters)
+    updateDistances(cluster);
+  dirty.resize(clusters.size());
+}
+
+int PathAbstraction::getIndex(Vec2 v) const {
+  return getLocalIndex(area, v);
+}
+
+double PathAbstraction::getCost(Vec2 v) const {
+  return costs[getIndex(v)];
+}
+
+bool PathAbstraction::isPassable(Vec2 v) const {
+  return getCost(v) < ShortestPath::infinity;
+}
+
+int PathAbstraction::getCluster(Vec2 v) const {
+  return ((v.x - area.left()) / clusterSize) * numClustersY + (v.y - area.top()) / clusterSize;
+}
+
+// Both clusters of a border scan it in the same direction, so they choose matching transitions.
+void PathAbstraction::updateNodes(Cluster& cluster) {
+  for (auto v : cluster.nodes)
+    nodeIndex[getIndex(v)] = -1;
+  cluster.nodes.clear();
+  auto addNode = [&] (Vec2 v) {
+    auto& index = nodeIndex[getIndex(v)];
+    if (index == -1) {
+      index = cluster.nodes.size();
+      cluster.nodes.push_back(v);
+    }
+  };
+  // The border starts at the given tile and runs along dir, with the neighbouring cluster in the out direction.
+  auto addBorder = [&] (Vec2 start, Vec2 dir, Vec2 out, int length) {
+    if (!(start + out).inRectangle(area))
+      return;
+    int runStart = -1;
+    for (int i = 0; i <= length; ++i) {
+      bool open = i < length && isPassable(start + dir * i) && isPassable(start + dir * i + out);
+      if (open && runStart == -1)
+        runStart = i;
+      else if (!open && runStart != -1) {
+        if (i - runStart < maxSingleTransitionLength)
+          addNode(start + dir * ((runStart + i - 1) / 2));
+        else {
+          addNode(start + dir * runStart);
+          addNode(start + dir * (i - 1));
+        }
+        runStart = -1;
+      }
+    }
+  };
+  auto& r = cluster.area;
+  addBorder(r.topLeft(), Vec2(0, 1), Vec2(-1, 0), r.height());
+  addBorder(Vec2(r.right() - 1, r.top()), Vec2(0, 1), Vec2(1, 0), r.height());
+  addBorder(r.topLeft(), Vec2(1, 0), Vec2(0, -1), r.width());
+  addBorder(Vec2(r.left(), r.bottom() - 1), Vec2(1, 0), Vec2(0, 1), r.width());
+}
+
+void PathAbstraction::updateDistances(Cluster& cluster) {
+  int n = cluster.nodes.size();
+  cluster.distances.resize(n * n);
+  for (int i : Range(n)) {
+    searchCluster(cluster.area, cluster.nodes[i], false);
+    for (int j : Range(n))
+      cluster.distances[i * n + j] = localDistance[getLocalIndex(cluster.area, cluster.nodes[j])];
+  }
+}
+
+// Dijkstra within the area. The reverse search gives the distances to 'from' instead of from it.
+void PathAbstraction::searchCluster(const Rectangle& r, Vec2 from, bool reverse, optional<Vec2> to) {
+  localDistance.assign(r.width() * r.height(), ShortestPath::infinity);
+  localParent.assign(r.width() * r.height(), -1);
+  heap.clear();
+  auto compare = [] (const HeapElem& e1, const HeapElem& e2) {
+    return e1.distance > e2.distance || (e1.distance == e2.distance && e1.index > e2.index);
+  };
+  auto push = [&] (double distance, int index, Vec2 pos) {
+    heap.push_back({distance, index, pos});
+    std::push_heap(heap.begin(), heap.end(), compare);
+  };
+  localDistance[getLocalIndex(r, from)] = 0;
+  push(0, getLocalIndex(r, from), from);
+  while (!heap.empty()) {
+    auto [distance, index, v] = heap.front();
+    std::pop_heap(heap.begin(), heap.end(), compare);
+    heap.pop_back();
+    if (distance > localDistance[index])
+      continue;
+    if (to && *to == v)
+      return;
+    if (reverse && !isPassable(v))
+      continue;
+    for (auto dir : Vec2::directions4()) {
+      auto next = v + dir;
+      if (!next.inRectangle(r))
+        continue;
+      double step = reverse ? getCost(v) : getCost(next);
+      int nextIndex = getLocalIndex(r, next);
+      if (step < ShortestPath::infinity && distance + step < localDistance[nextIndex]) {
+        localDistance[nextIndex] = distance + step;
+        localParent[nextIndex] = index;
+        push(distance + step, nextIndex, next);
+      }
+    }
+  }
+}
+
+bool PathAbstraction::addRefinedPath(const Rectangle& r, Vec2 from, Vec2 to, vector<Vec2>& path) {
+  searchCluster(r, from, false, to);
+  if (localDistance[getLocalIndex(r, to)] >= ShortestPath::infinity)
+    return false;
+  int size = path.size();
+  for (int index = getLocalIndex(r, to); index != getLocalIndex(r, from); index = localParent[index])
+    path.push_back(getLocalPosition(r, index));
+  std::reverse(path.begin() + size, path.end());
+  return true;
+}
+
+void PathAbstraction::update(const vector<Vec2>& changed) {
+  vector<int> dirtyClusters;
+  auto markDirty = [&] (int cluster) {
+    if (!dirty[cluster]) {
+      dirty[cluster] = true;
+      dirtyClusters.push_back(cluster);
+    }
+  };
+  for (auto v : changed) {
+    minCost = min(minCost, max(0.0, getCost(v)));
+    int cluster = getCluster(v);
+    markDirty(cluster);
+    // Transitions depend on the tiles on both sides of the border.
+    for (auto dir : Vec2::directions4()) {
+      auto neighbor = v + dir;
+      if (neighbor.inRectangle(area) && getCluster(neighbor) != cluster)
+        markDirty(getCluster(neighbor));
+    }
+  }
+  for (int cluster : dirtyClusters)
+    updateNodes(clusters[cluster]);
+  for (int cluster : dirtyClusters) {
+    updateDistances(clusters[cluster]);
+    dirty[cluster] = false;
+  }
+}
+
+vector<Vec2> PathAbstraction::findPath(Vec2 from, Vec2 to) {
+  CHECK(from.inRectangle(area) && to.inRectangle(area));
+  auto fromCluster = (from - area.topLeft()) / clusterSize;
+  auto toCluster = (to - area.topLeft()) / clusterSize;
+  vector<Vec2> ret;
+  ret.push_back(from);
+  // Nearby tiles are joined by an exact search in the clusters around them, unless they aren't connected there.
+  if (abs(fromCluster.x - toCluster.x) <= 1 && abs(fromCluster.y - toCluster.y) <= 1) {
+    auto corner = area.topLeft() + Vec2(min(fromCluster.x, toCluster.x) - 1, min(fromCluster.y, toCluster.y) - 1)
+        * clusterSize;
+    auto window = Rectangle(corner, corner + Vec2(abs(fromCluster.x - toCluster.x) + 3,
+        abs(fromCluster.y - toCluster.y) + 3) * clusterSize).intersection(area);
+    if (addRefinedPath(window, from, to, ret))
+      return ret;
+  }
+  auto& startCluster = clusters[getCluster(from)];
+  searchCluster(startCluster.area, from, false);
+  vector<double> startDistances;
+  for (auto v : startCluster.nodes)
+    startDistances.push_back(localDistance[getLocalIndex(startCluster.area, v)]);
+  int goalCluster = getCluster(to);
+  searchCluster(clusters[goalCluster].area, to, true);
+  vector<double> goalDistances;
+  for (auto v : clusters[goalCluster].nodes)
+    goalDistances.push_back(localDistance[getLocalIndex(clusters[goalCluster].area, v)]);
+  // A* over the transitions, with tiles identified by their index in the area.
+  int fromKey = getIndex(from);
+  int toKey = getIndex(to);
+  unordered_map<int, double> distance;
+  unordered_map<int, int> parent;
+  unordered_set<int> closed;
+  std::vector<pair<double, int>> queue;
+  auto relax = [&] (int fromKey, Vec2 v, double d) {
+    int key = getIndex(v);
+    auto current = distance.find(key);
+    if (current == distance.end() || d < current->second) {
+      distance[key] = d;
+      parent[key] = fromKey;
+      queue.push_back({d + minCost * v.dist4(to), key});
+      std::push_heap(queue.begin(), queue.end(), std::greater<>());
+    }
+  };
+  distance[fromKey] = 0;
+  queue.push_back({minCost * from.dist4(to), fromKey});
+  bool found = false;
+  while (!queue.empty()) {
+    int key = queue.front().second;
+    std::pop_heap(queue.begin(), queue.end(), std::greater<>());
+    queue.pop_back();
+    if (!closed.insert(key).second)
+      continue;
+    if (key == toKey) {
+      found = true;
+      break;
+    }
+    auto v = getLocalPosition(area, key);
+    double d = distance.at(key);
+    int clusterIndex = getCluster(v);
+    auto& cluster = clusters[clusterIndex];
+    int node = nodeIndex[key];
+    if (key == fromKey) {
+      for (int j : All(startCluster.nodes))
+        if (startDistances[j] < ShortestPath::infinity)
+          relax(key, startCluster.nodes[j], d + startDistances[j]);
+    } else if (node != -1) {
+      int n = cluster.nodes.size();
+      for (int j : Range(n))
+        if (j != node && cluster.distances[node * n + j] < ShortestPath::infinity)
+          relax(key, cluster.nodes[j], d + cluster.distances[node * n + j]);
+      if (clusterIndex == goalCluster && goalDistances[node] < ShortestPath::infinity)
+        relax(key, to, d + goalDistances[node]);
+    }
+    if (node != -1)
+      for (auto dir : Vec2::directions4()) {
+        auto next = v + dir;
+        if (next.inRectangle(area) && getCluster(next) != clusterIndex && nodeIndex[getIndex(next)] != -1 &&
+            isPassable(next))
+          relax(key, next, d + getCost(next));
+      }
+  }
+  if (!found)
+    return {};
+  vector<int> keys;
+  for (int key = toKey; key != fromKey; key = parent.at(key))
+    keys.push_back(key);
+  keys.push_back(fromKey);
+  std::reverse(keys.begin(), keys.end());
+  for (int i : Range(1, keys.size())) {
+    auto v1 = getLocalPosition(area, keys[i - 1]);
+    auto v2 = getLocalPosition(area, keys[i]);
+    if (getCluster(v1) == getCluster(v2)) {
+      bool refined = addRefinedPath(clusters[getCluster(v1)].area, v1, v2, ret);
+      CHECK(refined);
+    } else
+      ret.push_back(v2);
+  }
+  return ret;
+}
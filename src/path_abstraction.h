@@ -0,0 +1,59 @@
+#pragma once
+
+#include "stdafx.h"
+#include "util.h"
+
+// Finds near-optimal paths by searching a graph of cluster transitions instead of the tiles, as in HPA* (Botea,
+// Müller and Schaeffer). The area is split into square clusters. Every stretch of open border between two
+// neighbouring clusters gets one or two transitions, and the distances between the transitions of each cluster are
+// computed up front, so that a search only visits a few nodes per cluster. The path is then refined into tiles
+// cluster by cluster. Tiles in the same or neighbouring clusters are joined with an exact search in the clusters
+// around them instead.
+// Costs are read from a column-major array over the area, which must outlive the abstraction. A move costs the
+// entry cost of the tile it enters, and tiles costing ShortestPath::infinity are impassable.
+class PathAbstraction {
+  public:
+  PathAbstraction(Rectangle area, const vector<double>& costs, int clusterSize = 16);
+  PathAbstraction(const PathAbstraction&) = delete;
+  // Rebuilds the clusters around tiles whose cost changed.
+  void update(const vector<Vec2>& changed);
+  // Returns the tiles from 'from' to 'to', both included, or nothing if there is no path.
+  vector<Vec2> findPath(Vec2 from, Vec2 to);
+
+  private:
+  struct Cluster {
+    Rectangle area;
+    vector<Vec2> nodes;
+    // From every node to every node, nodes.size() squared.
+    vector<double> distances;
+  };
+  int getIndex(Vec2) const;
+  double getCost(Vec2) const;
+  bool isPassable(Vec2) const;
+  int getCluster(Vec2) const;
+  void updateNodes(Cluster&);
+  void updateDistances(Cluster&);
+  void searchCluster(const Rectangle&, Vec2 from, bool reverse, optional<Vec2> to = none);
+  // Appends the tiles after 'from' up to 'to', or returns false if they aren't connected within the area.
+  bool addRefinedPath(const Rectangle&, Vec2 from, Vec2 to, vector<Vec2>& path);
+  Rectangle area;
+  const vector<double>& costs;
+  int clusterSize;
+  int numClustersX;
+  int numClustersY;
+  vector<Cluster> clusters;
+  // The index of every tile in its cluster's nodes, or -1.
+  vector<int> nodeIndex;
+  // A lower bound of the cost of any tile, for the heuristic.
+  double minCost;
+  // Results of searchCluster, indexed within the searched area.
+  std::vector<double> localDistance;
+  std::vector<int> localParent;
+  struct HeapElem {
+    double distance;
+    int index;
+    Vec2 pos;
+  };
+  std::vector<HeapElem> heap;
+  vector<char> dirty;
+};
@@ -1,26 +1,30 @@
 #include "util.h"
 #include "perlin_noise.h"
 
-void addAvg(int x, int y, const Table<double>& wys, double& avg, int& num) {
-  Vec2 pos(x, y);
-  if (pos.inRectangle(wys.getBounds())) {
-    avg += wys[pos];
+static void addAvg(int x, int y, const vector<double>& wys, int width, double& avg, int& num) {
+  if (x >= 0 && y >= 0 && x < width && y < width) {
+    avg += wys[x * width + y];
     ++num;
   }
 }
 
-Table<double> genNoiseMap(RandomGen& random, Rectangle area, NoiseInit init, double varianceMult) {
+void genNoiseMap(RandomGen& random, Rectangle area, NoiseInit init, double varianceMult, vector<double>& values,
+    vector<double>& wys) {
   int width = 1;
   while (width < area.width() - 1 || width < area.height() - 1)
     width *= 2;
   width /= 2;
   ++width;
-  Table<double> wys(width, width);
-  wys[0][0] = init.topLeft;
-  wys[width - 1][0] = init.topRight;
-  wys[width - 1][width - 1] = init.bottomRight;
-  wys[0][width - 1] = init.bottomLeft;
-  wys[(width - 1) / 2][(width - 1) / 2] = init.middle;
+  wys.clear();
+  wys.resize(width * width);
+  auto at = [&] (int x, int y) -> double& {
+    return wys[x * width + y];
+  };
+  at(0, 0) = init.topLeft;
+  at(width - 1, 0) = init.topRight;
+  at(width - 1, width - 1) = init.bottomRight;
+  at(0, width - 1) = init.bottomLeft;
+  at((width - 1) / 2, (width - 1) / 2) = init.middle;
 
   double variance = 0.5;
   double heightDiff = 0.1;
@@ -28,39 +32,37 @@ Table<double> genNoiseMap(RandomGen& random, Rectangle area, NoiseInit init, dou
     if (a < width - 1)
       for (Vec2 pos1 : Rectangle((width - 1) / a, (width - 1) / a)) {
         Vec2 pos = pos1 * a;
-        double avg = (wys[pos] + wys[pos.x + a][pos.y] + wys[pos.x][pos.y + a] + wys[pos.x + a][pos.y + a]) / 4;
-        wys[pos.x + a / 2][pos.y + a / 2] =
+        double avg = (at(pos.x, pos.y) + at(pos.x + a, pos.y) + at(pos.x, pos.y + a) + at(pos.x + a, pos.y + a)) / 4;
+        at(pos.x + a / 2, pos.y + a / 2) =
             avg + variance * (random.getDouble() * 2 - 1);
       }
     for (Vec2 pos1 : Rectangle((width - 1) / a, (width - 1) / a + 1)) {
       Vec2 pos = pos1 * a;
       double avg = 0;
       int num = 0;
-      addAvg(pos.x + a / 2, pos.y - a / 2, wys, avg, num);
-      addAvg(pos.x, pos.y, wys, avg, num);
-      addAvg(pos.x + a, pos.y, wys, avg, num);
-      addAvg(pos.x + a / 2, pos.y + a / 2, wys, avg, num);
-      wys[pos.x + a / 2][pos.y] =
+      addAvg(pos.x + a / 2, pos.y - a / 2, wys, width, avg, num);
+      addAvg(pos.x, pos.y, wys, width, avg, num);
+      addAvg(pos.x + a, pos.y, wys, width, avg, num);
+      addAvg(pos.x + a / 2, pos.y + a / 2, wys, width, avg, num);
+      at(pos.x + a / 2, pos.y) =
           avg / num + variance * (random.getDouble() * 2 - 1);
     }
     for (Vec2 pos1 : Rectangle((width - 1) / a + 1, (width - 1) / a)) {
       Vec2 pos = pos1 * a;
       double avg = 0;
       int num = 0;
-      addAvg(pos.x - a / 2, pos.y + a / 2, wys, avg, num);
-      addAvg(pos.x, pos.y, wys, avg, num);
-      addAvg(pos.x, pos.y + a , wys, avg, num);
-      addAvg(pos.x + a / 2, pos.y + a / 2, wys, avg, num);
-      wys[pos.x][pos.y + a / 2] =
+      addAvg(pos.x - a / 2, pos.y + a / 2, wys, width, avg, num);
+      addAvg(pos.x, pos.y, wys, width, avg, num);
+      addAvg(pos.x, pos.y + a , wys, width, avg, num);
+      addAvg(pos.x + a / 2, pos.y + a / 2, wys, width, avg, num);
+      at(pos.x, pos.y + a / 2) =
           avg / num + variance * (random.getDouble() * 2 - 1);
     }
     variance *= varianceMult;
   }
-  Table<double> ret(area);
-  Vec2 offset(area.left(), area.top());
-  for (Vec2 v : area) {
-    Vec2 lv((v.x - offset.x) * width / area.width(), (v.y - offset.y) * width / area.height());
-    ret[v] = wys[lv];
-  }
-  return ret;
+  values.clear();
+  values.reserve(area.width() * area.height());
+  for (int x = 0; x < area.width(); ++x)
+    for (int y = 0; y < area.height(); ++y)
+      values.push_back(at(x * width / area.width(), y * width / area.height()));
 }
@@ -11,4 +11,7 @@ struct NoiseInit {
   int middle;
 };
 
-Table<double> genNoiseMap(RandomGen& random, Rectangle area, NoiseInit, double varianceMult);
+// Writes the noise value of every tile of the area to values, column by column. The other buffer is used as scratch
+// space, both are passed in so that they can be reused.
+void genNoiseMap(RandomGen& random, Rectangle area, NoiseInit, double varianceMult, vector<double>& values,
+    vector<double>& scratch);
@@ -1,5 +1,7 @@
 #include "stdafx.h"
 #include "predicate.h"
+#include "profiler.h"
+#include "optimizer.h"
 
 static bool apply(const TilePredicates::On& p, LayoutCanvas::Map* map, Vec2 v, RandomGen& r) {
   return map->elems[v].contains(p.token);
@@ -47,6 +49,88 @@ static bool apply(const TilePredicates::YMod& p, LayoutCanvas::Map* map, Vec2 v,
   return v.y % p.div == p.mod;
 }
 
+static int getIndex(Rectangle bounds, Vec2 v) {
+  return (v.x - bounds.left()) * bounds.height() + v.y - bounds.top();
+}
+
+static bool updateSources(const TilePredicates::Distance& p, LayoutCanvas::Map* map, Rectangle area, RandomGen& r,
+    LayoutCanvas::Map::DistanceField& field) {
+  auto bounds = map->elems.getBounds();
+  bool changed = false;
+  for (int x = area.left(); x < area.right(); ++x)
+    for (int y = area.top(); y < area.bottom(); ++y) {
+      auto& source = field.sources[getIndex(bounds, Vec2(x, y))];
+      char value = p.predicate->apply(map, Vec2(x, y), r);
+      changed |= source != value;
+      source = value;
+    }
+  return changed;
+}
+
+// Only the sources around tiles modified since the last query are evaluated again. If any of them changed, the
+// distances are left stale until they are needed, see apply().
+static LayoutCanvas::Map::DistanceField& getDistanceField(const TilePredicates::Distance& p,
+    LayoutCanvas::Map* map, RandomGen& r) {
+  auto bounds = map->elems.getBounds();
+  auto& log = map->distanceFieldLog;
+  auto it = map->distanceFields.find(&p);
+  if (it == map->distanceFields.end()) {
+    LayoutCanvas::Map::DistanceField field{{}, {}, getReadRadius(*p.predicate), 0, true, 0};
+    field.sources.resize(bounds.width() * bounds.height());
+    updateSources(p, map, bounds, r, field);
+    field.logPosition = log.size();
+    it = map->distanceFields.insert(make_pair(&p, std::move(field))).first;
+  }
+  auto& field = it->second;
+  if (field.logPosition < log.size()) {
+    if (!field.readRadius)
+      field.stale |= updateSources(p, map, bounds, r, field);
+    else
+      for (int i = field.logPosition; i < log.size(); ++i) {
+        auto area = Rectangle::centered(log[i], *field.readRadius);
+        if (area.intersects(bounds))
+          field.stale |= updateSources(p, map, area.intersection(bounds), r, field);
+      }
+    field.logPosition = log.size();
+    bool caughtUp = true;
+    for (auto& elem : map->distanceFields)
+      caughtUp &= elem.second.logPosition == log.size();
+    if (caughtUp) {
+      log.clear();
+      for (auto& elem : map->distanceFields)
+        elem.second.logPosition = 0;
+    }
+  }
+  return field;
+}
+
+// While the distances are stale, a tile is checked by looking for sources closer than max around it. Any source
+// closer than max is inside the window, so the result is exact. The distances are computed again once the checks
+// have cost about as much as that, so that predicates that keep changing their own sources stay linear.
+static bool apply(const TilePredicates::Distance& p, LayoutCanvas::Map* map, Vec2 v, RandomGen& r) {
+  auto bounds = map->elems.getBounds();
+  auto& field = getDistanceField(p, map, r);
+  if (field.stale) {
+    int radius = int(std::ceil(min<double>(p.max, bounds.width() + bounds.height())));
+    auto window = Rectangle::centered(v, radius).intersection(bounds);
+    if (field.staleChecks + window.area() < field.sources.size()) {
+      field.staleChecks += window.area();
+      double distance = std::numeric_limits<double>::infinity();
+      for (auto u : window)
+        if (field.sources[getIndex(bounds, u)])
+          distance = min(distance, getDistance(p.metric, v, u));
+      return distance >= p.min && distance < p.max;
+    }
+    genDistanceField(bounds, p.metric, field.sources, field.distances);
+    field.stale = false;
+    field.staleChecks = 0;
+  }
+  double distance = field.distances[getIndex(bounds, v)];
+  return distance >= p.min && distance < p.max;
+}
+
 bool TilePredicate::apply(LayoutCanvas::Map* map, Vec2 v, RandomGen& r) const {
+  if (map->profiler)
+    map->profiler->addPredicateEvaluation();
   return visit<bool>([&](const auto& p) { return ::apply(p, map, v, r); });
 }
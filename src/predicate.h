@@ -4,8 +4,7 @@
 #include "util.h"
 #include "pretty_archive.h"
 #include "canvas.h"
-
-using Token = string;
+#include "distance_transform.h"
 
 struct TilePredicate;
 
@@ -59,6 +58,17 @@ struct YMod {
   SERIALIZE_ALL(roundBracket(), NAMED(div), NAMED(mod))
 };
 
+// True if the distance to the nearest tile matching the predicate is at least min and less than max. The distances
+// are computed for the whole map at once and cached until the matching tiles change, so the predicate is evaluated
+// on a tile when the distances are computed or a tile it reads is modified, not on every query.
+struct Distance {
+  double SERIAL(min);
+  double SERIAL(max);
+  HeapAllocated<TilePredicate> SERIAL(predicate);
+  DistanceMetric SERIAL(metric) = DistanceMetric::EUCLIDEAN;
+  SERIALIZE_ALL(roundBracket(), NAMED(min), NAMED(max), NAMED(predicate), OPTION(metric))
+};
+
 #define VARIANT_TYPES_LIST\
   X(On, 0)\
   X(Not, 1)\
@@ -68,7 +78,8 @@ struct YMod {
   X(Chance, 5)\
   X(Area, 6)\
   X(XMod, 7)\
-  X(YMod, 8)
+  X(YMod, 8)\
+  X(Distance, 9)
 
 #define VARIANT_NAME PredicateImpl
 
@@ -47,13 +47,13 @@ static vector<vector<StreamChar>> parseArgs(const vector<StreamChar>& s, int& in
     while (1) {
       eatWhitespace(s, index);
       optional<int> beginArg;
-      if (s[index].c != ')')
+      if (index < s.size() && s[index].c != ')')
         beginArg = index;
       eatArgument(s, index);
       if (beginArg) {
         eatWhitespace(s, *beginArg);
         ret.push_back(subStream(s, *beginArg, index - *beginArg));
-        while (isspace(ret.back().back().c))
+        while (!ret.back().empty() && isspace(ret.back().back().c))
           ret.back().pop_back();
       }
       if (index >= s.size())
@@ -61,7 +61,7 @@ static vector<vector<StreamChar>> parseArgs(const vector<StreamChar>& s, int& in
       if (s[index].c == ',')
         ++index;
       eatWhitespace(s, index);
-      if (s[index].c == ')') {
+      if (index < s.size() && s[index].c == ')') {
         ++index;
         break;
       }
@@ -83,7 +83,7 @@ string getString(const vector<StreamChar>& s) {
 void eatArgument(const vector<StreamChar>& s, int& index) {
   while (1) {
     eatWhitespace(s, index);
-    if (s[index].c == ')')
+    if (index >= s.size() || s[index].c == ')')
       return;
     if (s[index].c == '(')
       parseArgs(s, index);
@@ -332,6 +332,15 @@ string PrettyInputArchive::peek(int cnt) {
   return s;
 }
 
+StreamPosStack PrettyInputArchive::getPosition() {
+  auto b = bookmark();
+  is >> std::ws;
+  long n = is ? (long) is.tellg() : b;
+  is.clear();
+  seek(b);
+  return streamPos.empty() ? StreamPosStack() : streamPos[max(0, min<int>(n, streamPos.size() - 1))];
+}
+
 long PrettyInputArchive::bookmark() {
   return is.tellg();
 }
@@ -358,6 +367,7 @@ void prettyEpilogue(PrettyInputArchive& ar1) {
     bool appending = ar1.eatMaybe("append") || ar1.getNode().inherited;
     ar1.openBracket(bracket);
     bool keysAndValues = false;
+    bool positional = false;
     set<string> processed;
     while (!ar1.isCloseBracket(bracket)) {
       if (ar1.peek() == ",")
@@ -370,16 +380,21 @@ void prettyEpilogue(PrettyInputArchive& ar1) {
         if (keysAndValues)
           ar1.error("Expected a \"key = value\" pair");
         ar1.seek(bookmark);
+        // Values in the order of the fields. Only the metric option may follow them as a "key = value" pair.
         for (auto& loader : loaders) {
-          if (ar1.isCloseBracket(bracket))
+          if (ar1.isCloseBracket(bracket) || (ar1.peek() == "metric" && ar1.peek(2) == "="))
             break;
           processed.insert(loader.name);
           loader.load(true);
           ar1.eatMaybe(",");
         }
-        break;
-      } else
+        keysAndValues = positional = true;
+        continue;
+      } else {
+        if (positional && name != "metric")
+          ar1.error("Only \"metric\" can follow positional values, got: \"" + name + "\"");
         keysAndValues = true;
+      }
       bool found = false;
       for (auto& loader : loaders)
         if (loader.name == name) {
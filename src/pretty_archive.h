@@ -93,6 +93,7 @@ class PrettyInputArchive {
     }
 
     long bookmark();
+    StreamPosStack getPosition();
 
     template <typename T>
     void loadInherited(T& elem) {
@@ -335,6 +336,16 @@ inline void serialize(PrettyInputArchive& ar1, unique_ptr<T>& v) {
   v.reset(t);
 }
 
+template <typename T>
+inline void serialize(PrettyInputArchive& ar1, arena_ptr<T>& v) {
+  v.reset();
+  if (ar1.eatMaybe("none"))
+    return;
+  T* t = new T();
+  ar1(*t);
+  v.reset(t);
+}
+
 struct EndPrettyInput {};
 
 EndPrettyInput& endInput();
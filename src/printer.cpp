@@ -0,0 +1,350 @@
+#include "printer.h"
+#include "generator.h"
+
+static void print(ostream&, const LayoutGenerator&, int indent);
+static void print(ostream&, const TilePredicate&);
+
+static void newLine(ostream& o, int indent) {
+  o << "\n" << string(2 * indent, ' ');
+}
+
+static void print(ostream& o, const Token& t) {
+  o << std::quoted(t.getName());
+}
+
+static void print(ostream& o, const vector<Token>& tokens) {
+  for (int i : All(tokens)) {
+    if (i > 0)
+      o << ", ";
+    print(o, tokens[i]);
+  }
+}
+
+static void print(ostream& o, Vec2 v) {
+  o << "{" << v.x << ", " << v.y << "}";
+}
+
+static void print(ostream& o, Range r) {
+  if (r.getEnd() == r.getStart() + 1)
+    o << r.getStart();
+  else
+    o << "{" << r.getStart() << ", " << r.getEnd() << "}";
+}
+
+static void printSize(ostream& o, const optional<Vec2>& size, const optional<Vec2>& minSize,
+    const optional<Vec2>& maxSize) {
+  if (size) {
+    o << "size = ";
+    print(o, *size);
+  } else {
+    o << "minSize = ";
+    print(o, *minSize);
+    o << ", maxSize = ";
+    print(o, *maxSize);
+  }
+}
+
+static void print(ostream& o, const LayoutGenerators::Set& g, int) {
+  o << "Set(";
+  print(o, g.tokens);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::SetFront& g, int) {
+  o << "SetFront(";
+  print(o, g.token);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::Reset& g, int) {
+  o << "Reset(";
+  print(o, g.tokens);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::Remove& g, int) {
+  o << "Remove(";
+  print(o, g.tokens);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::Filter& g, int indent) {
+  o << "Filter(";
+  print(o, g.predicate);
+  o << ", ";
+  print(o, *g.generator, indent);
+  if (g.alt) {
+    o << ", ";
+    print(o, *g.alt, indent);
+  }
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::MarginImpl& g, int indent) {
+  o << "MarginImpl(" << EnumInfo<MarginType>::getString(g.type) << ", " << g.width << ", ";
+  print(o, *g.border, indent);
+  o << ", ";
+  print(o, *g.inside, indent);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::Margins& g, int indent) {
+  o << "Margins(" << g.width << ", ";
+  print(o, *g.border, indent);
+  o << ", ";
+  print(o, *g.inside, indent);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::SplitH& g, int indent) {
+  o << "SplitH(" << g.r << ", ";
+  print(o, *g.left, indent);
+  o << ", ";
+  print(o, *g.right, indent);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::SplitV& g, int indent) {
+  o << "SplitV(" << g.r << ", ";
+  print(o, *g.top, indent);
+  o << ", ";
+  print(o, *g.bottom, indent);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::Position& g, int indent) {
+  o << "Position(position = " << EnumInfo<PlacementPos>::getString(g.position) << ", ";
+  printSize(o, g.size, g.minSize, g.maxSize);
+  o << ", generator = ";
+  print(o, *g.generator, indent);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::Place& g, int indent) {
+  o << "Place(";
+  for (int i : All(g.generators)) {
+    auto& elem = g.generators[i];
+    if (i > 0)
+      o << ",";
+    newLine(o, indent + 1);
+    o << "(";
+    printSize(o, elem.size, elem.minSize, elem.maxSize);
+    o << ", generator = ";
+    print(o, *elem.generator, indent + 1);
+    o << ", count = ";
+    print(o, elem.count);
+    o << ", predicate = ";
+    print(o, elem.predicate);
+    o << ", minSpacing = " << elem.minSpacing << ")";
+  }
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::NoiseMap& g, int indent) {
+  o << "NoiseMap(";
+  for (int i : All(g.generators)) {
+    auto& elem = g.generators[i];
+    if (i > 0)
+      o << ",";
+    newLine(o, indent + 1);
+    o << "(" << elem.lower << ", " << elem.upper << ", ";
+    print(o, *elem.generator, indent + 1);
+    o << ")";
+  }
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::DistanceField& g, int indent) {
+  o << "DistanceField(from = ";
+  print(o, g.from);
+  o << ", bands = {";
+  for (auto& elem : g.bands) {
+    newLine(o, indent + 1);
+    o << "(" << elem.lower << ", " << elem.upper << ", ";
+    print(o, *elem.generator, indent + 1);
+    o << ")";
+  }
+  newLine(o, indent);
+  o << "}";
+  if (g.metric != DistanceMetric::EUCLIDEAN)
+    o << ", metric = " << EnumInfo<DistanceMetric>::getString(g.metric);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::Chain& g, int indent) {
+  if (g.generators.empty()) {
+    o << "{}";
+    return;
+  }
+  o << "{";
+  for (auto& gen : g.generators) {
+    newLine(o, indent + 1);
+    print(o, gen, indent + 1);
+  }
+  newLine(o, indent);
+  o << "}";
+}
+
+static void print(ostream& o, const LayoutGenerators::Choose& g, int indent) {
+  o << "Choose(";
+  for (int i : All(g.generators)) {
+    auto& elem = g.generators[i];
+    if (i > 0)
+      o << ",";
+    newLine(o, indent + 1);
+    if (elem.chance)
+      o << *elem.chance << " ";
+    print(o, *elem.generator, indent + 1);
+  }
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::Connect& g, int indent) {
+  o << "Connect(";
+  print(o, g.toConnect);
+  for (auto& elem : g.elems) {
+    o << ",";
+    newLine(o, indent + 1);
+    o << "(";
+    if (elem.cost)
+      o << *elem.cost;
+    else
+      o << "none";
+    o << ", ";
+    print(o, elem.predicate);
+    o << ", ";
+    print(o, *elem.generator, indent + 1);
+    o << ")";
+  }
+  if (g.search != ConnectSearch::EXACT)
+    o << ", search = " << EnumInfo<ConnectSearch>::getString(g.search);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::Repeat& g, int indent) {
+  o << "Repeat(";
+  print(o, g.count);
+  o << ", ";
+  print(o, *g.generator, indent);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::Retry& g, int indent) {
+  o << "Retry(" << g.count << ", ";
+  print(o, *g.generator, indent);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::Try& g, int indent) {
+  o << "Try(";
+  print(o, *g.generator, indent);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::Stamp& g, int indent) {
+  o << "Stamp(";
+  print(o, *g.generator, indent);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::Symmetric& g, int indent) {
+  o << "Symmetric(mode = " << EnumInfo<SymmetryMode>::getString(g.mode) << ", generator = ";
+  print(o, *g.generator, indent);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerators::FloodFill& g, int indent) {
+  o << "FloodFill(";
+  print(o, g.predicate);
+  o << ", ";
+  print(o, *g.generator, indent);
+  o << ")";
+}
+
+static void print(ostream& o, const LayoutGenerator& g, int indent) {
+  g.visit([&o, indent] (const auto& g) { ::print(o, g, indent); });
+}
+
+static void print(ostream& o, const vector<TilePredicate>& predicates) {
+  for (int i : All(predicates)) {
+    if (i > 0)
+      o << ", ";
+    print(o, predicates[i]);
+  }
+}
+
+static void print(ostream& o, const TilePredicates::On& p) {
+  o << "On(";
+  print(o, p.token);
+  o << ")";
+}
+
+static void print(ostream& o, const TilePredicates::Not& p) {
+  o << "Not ";
+  print(o, *p.predicate);
+}
+
+static void print(ostream& o, const TilePredicates::True&) {
+  o << "True";
+}
+
+static void print(ostream& o, const TilePredicates::And& p) {
+  o << "And(";
+  print(o, p.predicates);
+  o << ")";
+}
+
+static void print(ostream& o, const TilePredicates::Or& p) {
+  o << "Or(";
+  print(o, p.predicates);
+  o << ")";
+}
+
+static void print(ostream& o, const TilePredicates::Chance& p) {
+  o << "Chance(" << p.value << ")";
+}
+
+static void print(ostream& o, const TilePredicates::Area& p) {
+  o << "Area(" << p.radius << ", ";
+  print(o, *p.predicate);
+  o << ", " << p.minCount << ")";
+}
+
+static void print(ostream& o, const TilePredicates::Distance& p) {
+  o << "Distance(" << p.min << ", " << p.max << ", ";
+  print(o, *p.predicate);
+  if (p.metric != DistanceMetric::EUCLIDEAN)
+    o << ", metric = " << EnumInfo<DistanceMetric>::getString(p.metric);
+  o << ")";
+}
+
+static void print(ostream& o, const TilePredicates::XMod& p) {
+  o << "XMod(" << p.div << ", " << p.mod << ")";
+}
+
+static void print(ostream& o, const TilePredicates::YMod& p) {
+  o << "YMod(" << p.div << ", " << p.mod << ")";
+}
+
+static void print(ostream& o, const TilePredicate& p) {
+  p.visit([&o] (const auto& p) { ::print(o, p); });
+}
+
+// Enough digits that every double reads back as the same value.
+static int setFullPrecision(ostream& o) {
+  return o.precision(std::numeric_limits<double>::max_digits10);
+}
+
+ostream& operator << (ostream& o, const LayoutGenerator& g) {
+  auto precision = setFullPrecision(o);
+  print(o, g, 0);
+  o.precision(precision);
+  return o;
+}
+
+ostream& operator << (ostream& o, const TilePredicate& p) {
+  auto precision = setFullPrecision(o);
+  print(o, p);
+  o.precision(precision);
+  return o;
+}
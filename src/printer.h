@@ -0,0 +1,10 @@
+#pragma once
+
+#include "stdafx.h"
+
+struct LayoutGenerator;
+struct TilePredicate;
+
+// Prints the program in the same syntax that PrettyInputArchive reads, so the output can be parsed back.
+ostream& operator << (ostream&, const LayoutGenerator&);
+ostream& operator << (ostream&, const TilePredicate&);
@@ -0,0 +1,88 @@
+#include "profiler.h"
+#include "generator.h"
+
+Profiler::Profiler() {
+  callTree.push_back(CallNode{nullptr, -1});
+  stack.push_back(Frame{0, steady_clock::now(), steady_clock::duration::zero()});
+}
+
+void Profiler::enter(const LayoutGenerator& generator, Rectangle area) {
+  int parent = stack.back().node;
+  int node = 0;
+  if (auto index = getReferenceMaybe(callTree[parent].children, &generator))
+    node = *index;
+  else {
+    node = callTree.size();
+    callTree[parent].children[&generator] = node;
+    callTree.push_back(CallNode{&generator, parent});
+  }
+  ++callTree[node].calls;
+  callTree[node].tiles += area.area();
+  stack.push_back(Frame{node, steady_clock::now(), steady_clock::duration::zero()});
+}
+
+void Profiler::exit() {
+  CHECK(stack.size() > 1);
+  auto frame = stack.back();
+  stack.pop_back();
+  auto elapsed = steady_clock::now() - frame.start;
+  callTree[frame.node].inclusive += elapsed;
+  callTree[frame.node].exclusive += elapsed - frame.childTime;
+  stack.back().childTime += elapsed;
+}
+
+void Profiler::addPredicateEvaluation() {
+  ++callTree[stack.back().node].predicateEvaluations;
+}
+
+void Profiler::addAttempt() {
+  ++callTree[stack.back().node].attempts;
+}
+
+static double toMillis(steady_clock::duration d) {
+  return duration_cast<microseconds>(d).count() / 1000.0;
+}
+
+void Profiler::printReport(ostream& o, const vector<string>& filenames) const {
+  map<string, CallNode> bySource;
+  for (auto& node : callTree)
+    if (node.generator) {
+      auto label = node.generator->getLabel(filenames);
+      auto& elem = bySource.insert(make_pair(label, CallNode{node.generator, -1})).first->second;
+      elem.calls += node.calls;
+      elem.tiles += node.tiles;
+      elem.predicateEvaluations += node.predicateEvaluations;
+      elem.attempts += node.attempts;
+      elem.inclusive += node.inclusive;
+      elem.exclusive += node.exclusive;
+    }
+  vector<pair<string, CallNode>> sorted(bySource.begin(), bySource.end());
+  std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+    return a.second.exclusive > b.second.exclusive; });
+  o << std::setw(12) << "excl ms" << std::setw(12) << "incl ms" << std::setw(12) << "calls"
+      << std::setw(14) << "tiles" << std::setw(14) << "predicates" << std::setw(12) << "attempts" << "  node\n";
+  o << std::fixed << std::setprecision(3);
+  for (auto& elem : sorted)
+    o << std::setw(12) << toMillis(elem.second.exclusive) << std::setw(12) << toMillis(elem.second.inclusive)
+        << std::setw(12) << elem.second.calls << std::setw(14) << elem.second.tiles
+        << std::setw(14) << elem.second.predicateEvaluations << std::setw(12) << elem.second.attempts
+        << "  " << elem.first << "\n";
+}
+
+string Profiler::getStack(int node, const vector<string>& filenames) const {
+  auto& elem = callTree[node];
+  auto label = elem.generator->getLabel(filenames);
+  if (callTree[elem.parent].generator)
+    return getStack(elem.parent, filenames) + ";" + label;
+  return label;
+}
+
+void Profiler::printFoldedStacks(ostream& o, const vector<string>& filenames) const {
+  map<string, long long> stacks;
+  for (int i : All(callTree))
+    if (callTree[i].generator)
+      stacks[getStack(i, filenames)] += duration_cast<microseconds>(callTree[i].exclusive).count();
+  for (auto& elem : stacks)
+    if (elem.second > 0)
+      o << elem.first << " " << elem.second << "\n";
+}
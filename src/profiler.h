@@ -0,0 +1,44 @@
+#pragma once
+
+#include "stdafx.h"
+#include "util.h"
+
+struct LayoutGenerator;
+
+// Collects per-node statistics while a program runs. Enabled by setting LayoutCanvas::Map::profiler.
+class Profiler {
+  public:
+  Profiler();
+  void enter(const LayoutGenerator&, Rectangle area);
+  void exit();
+  void addPredicateEvaluation();
+  // Place counts every placement try, Connect every path search.
+  void addAttempt();
+
+  // Statistics summed over all calls of each source node, sorted by exclusive time.
+  void printReport(ostream&, const vector<string>& filenames) const;
+  // Exclusive time in microseconds per call stack, in the format read by flamegraph.pl.
+  void printFoldedStacks(ostream&, const vector<string>& filenames) const;
+
+  private:
+  struct CallNode {
+    CallNode(const LayoutGenerator* generator, int parent) : generator(generator), parent(parent) {}
+    const LayoutGenerator* generator;
+    int parent;
+    map<const LayoutGenerator*, int> children;
+    long long calls = 0;
+    long long tiles = 0;
+    long long predicateEvaluations = 0;
+    long long attempts = 0;
+    steady_clock::duration inclusive = steady_clock::duration::zero();
+    steady_clock::duration exclusive = steady_clock::duration::zero();
+  };
+  struct Frame {
+    int node;
+    steady_clock::time_point start;
+    steady_clock::duration childTime;
+  };
+  vector<CallNode> callTree;
+  vector<Frame> stack;
+  string getStack(int node, const vector<string>& filenames) const;
+};
@@ -29,89 +29,172 @@ string getColorCode(const string& color) {
   return "\033[" + to_string(number) + "m";
 }
 
-template <typename Container, typename Fun>
-auto chooseBest(const Container& c, Fun f) {
-  auto ret = *c.begin();
-  int p = f(ret);
-  for (auto& elem : c) {
-    int np = f(elem);
-    if (np < p) {
-      p = np;
-      ret = elem;
-    }
-  }
-  return ret;
+namespace {
+struct GlyphTable {
+  struct Glyph {
+    string character;
+    int color;
+  };
+  // In the order of the glyph file. When a tile has several tokens with glyphs, the one defined last is shown.
+  vector<Glyph> glyphs;
+  unordered_map<Token, int> glyphIndex;
+  // The tag that switches to every distinct color.
+  vector<string> colorTags;
+};
 }
 
-void renderAscii(const LayoutCanvas::Map& map1, istream& file) {
-  unordered_map<string, string> tokens;
-  unordered_map<string, int> priority;
-  int cnt = 0;
+template <typename ColorFun>
+static GlyphTable readGlyphTable(istream& file, ColorFun getColorTag) {
+  GlyphTable ret;
+  unordered_map<string, int> colorIndex;
   while (1) {
     string token, character, color;
     file >> std::quoted(token) >> character >> color;
     if (!file)
       break;
-    tokens[token] = getColorCode(color) + character + "\033[0m";
-    priority[token] = cnt++;
+    auto tag = getColorTag(color);
+    if (!colorIndex.count(tag)) {
+      colorIndex[tag] = ret.colorTags.size();
+      ret.colorTags.push_back(tag);
+    }
+    ret.glyphIndex[Token(token)] = ret.glyphs.size();
+    ret.glyphs.push_back(GlyphTable::Glyph{character, colorIndex.at(tag)});
   }
-  for (auto y : map1.elems.getBounds().getYRange()) {
-    for (auto x : map1.elems.getBounds().getXRange()) {
-      auto& elems = map1.elems[x][y];
-      if (!elems.empty()) {
-        auto glyph = chooseBest(elems, [&](const Token& t) {
-          if (priority.count(t))
-            return -priority.at(t);
-          else
-            return 10000;
-        });
-        if (tokens.count(glyph)) {
-          std::cout << tokens.at(glyph);
-          continue;
-        }
+  return ret;
+}
+
+namespace {
+// Returns the glyph shown on a tile, or -1. Neighbouring tiles often have the same tokens, so the last tile's result
+// is reused for them.
+class GlyphChooser {
+  public:
+  GlyphChooser(const GlyphTable& table) : table(table) {}
+
+  int operator()(const TokenList& tokens) {
+    if (!lastTokens || tokens != *lastTokens) {
+      lastTokens = &tokens;
+      lastGlyph = -1;
+      for (auto& token : tokens)
+        if (auto glyph = getReferenceMaybe(table.glyphIndex, token))
+          lastGlyph = max(lastGlyph, *glyph);
+    }
+    return lastGlyph;
+  }
+
+  private:
+  const GlyphTable& table;
+  const TokenList* lastTokens = nullptr;
+  int lastGlyph = -1;
+};
+}
+
+// The glyph shown on every tile, row by row.
+static vector<int> getTileGlyphs(const LayoutCanvas::Map& map, const GlyphTable& table) {
+  auto& bounds = map.elems.getBounds();
+  vector<int> ret(bounds.width() * bounds.height());
+  GlyphChooser chooser(table);
+  map.elems.forEachChunk(bounds, [&] (Rectangle area) {
+    for (int x = area.left(); x < area.right(); ++x)
+      for (int y = area.top(); y < area.bottom(); ++y)
+        ret[(y - bounds.top()) * bounds.width() + x - bounds.left()] = chooser(map.elems[Vec2(x, y)]);
+  });
+  return ret;
+}
+
+// Writes the color tag only when the color changes, and closes it at the end of every line. Empty tiles don't
+// change the color.
+static string renderGlyphs(const LayoutCanvas::Map& map, const GlyphTable& table, const string& colorEnd,
+    const string& lineEnd) {
+  auto glyphs = getTileGlyphs(map, table);
+  auto& bounds = map.elems.getBounds();
+  string ret;
+  ret.reserve(glyphs.size() * 2 + bounds.height() * (lineEnd.size() + colorEnd.size()));
+  int index = 0;
+  for (int y = 0; y < bounds.height(); ++y) {
+    int color = -1;
+    for (int x = 0; x < bounds.width(); ++x) {
+      int glyph = glyphs[index++];
+      if (glyph == -1) {
+        ret += ' ';
+        continue;
+      }
+      auto& g = table.glyphs[glyph];
+      if (g.color != color) {
+        if (color != -1)
+          ret += colorEnd;
+        color = g.color;
+        ret += table.colorTags[color];
       }
-      std::cout << " ";
+      ret += g.character;
     }
-    std::cout << "\n";
+    if (color != -1)
+      ret += colorEnd;
+    ret += lineEnd;
   }
+  return ret;
 }
 
-static string getHtmlColor(string c, const string& color) {
-  return "<font color=\"" + color + "\">" + c + "</font>";
+void renderAscii(const LayoutCanvas::Map& map1, istream& file) {
+  auto table = readGlyphTable(file, [] (const string& color) { return getColorCode(color); });
+  auto output = renderGlyphs(map1, table, "\033[0m", "\n");
+  std::cout.write(output.data(), output.size());
 }
 
 string renderHtml(const LayoutCanvas::Map& map1, const char* renderer) {
-  string ret;
-  unordered_map<string, string> tokens;
-  unordered_map<string, int> priority;
-  int cnt = 0;
   istringstream file(renderer);
-  while (1) {
-    string token, character, color;
-    file >> std::quoted(token) >> character >> color;
-    if (!file)
-      break;
-    tokens[token] = getHtmlColor(character, color);
-    priority[token] = cnt++;
+  auto table = readGlyphTable(file, [] (const string& color) { return "<font color=\"" + color + "\">"; });
+  return renderGlyphs(map1, table, "</font>", "<br/>");
+}
+
+// Takes the colors used in the glyph file, or #rrggbb.
+static array<unsigned char, 3> getRgb(const string& color) {
+  static const unordered_map<string, array<unsigned char, 3>> colors {
+    {"black", {0, 0, 0}},
+    {"red", {170, 0, 0}},
+    {"green", {0, 170, 0}},
+    {"brown", {170, 85, 0}},
+    {"yellow", {255, 255, 85}},
+    {"blue", {0, 0, 170}},
+    {"magenta", {170, 0, 170}},
+    {"cyan", {0, 170, 170}},
+    {"white", {170, 170, 170}},
+    {"gray", {85, 85, 85}},
+  };
+  if (auto rgb = getReferenceMaybe(colors, color))
+    return *rgb;
+  if (color.size() == 7 && color[0] == '#' && color.find_first_not_of("0123456789abcdefABCDEF", 1) == string::npos) {
+    auto value = std::stoi(color.substr(1), nullptr, 16);
+    return {(unsigned char) (value >> 16), (unsigned char) (value >> 8), (unsigned char) value};
   }
-  for (auto y : map1.elems.getBounds().getYRange()) {
-    for (auto x : map1.elems.getBounds().getXRange()) {
-      auto& elems = map1.elems[x][y];
-      if (!elems.empty()) {
-        auto glyph = chooseBest(elems, [&](const Token& t) {
-          if (priority.count(t))
-            return -priority.at(t);
-          else
-            return 10000;
-        });
-        if (tokens.count(glyph)) {
-          ret += tokens.at(glyph);
-          continue;
-        }
-      }
-      ret += " ";
+  std::cout << "Unknown color: " << color << "\n";
+  return {170, 170, 170};
+}
+
+bool renderImage(const LayoutCanvas::Map& map1, istream& file, const string& path, ImageFormat format, int scale) {
+  auto table = readGlyphTable(file, [] (const string& color) { return color; });
+  vector<array<unsigned char, 3>> colors;
+  for (auto& color : table.colorTags)
+    colors.push_back(getRgb(color));
+  auto& bounds = map1.elems.getBounds();
+  ImageWriter writer(path, format, bounds.width() * scale, bounds.height() * scale);
+  if (!writer.good())
+    return false;
+  GlyphChooser chooser(table);
+  vector<unsigned char> row(bounds.width() * scale * 3);
+  for (int y = bounds.top(); y < bounds.bottom(); ++y) {
+    int pixel = 0;
+    for (int x = bounds.left(); x < bounds.right(); ++x) {
+      int glyph = chooser(map1.elems[Vec2(x, y)]);
+      // Tiles without a glyph are black.
+      array<unsigned char, 3> rgb {};
+      if (glyph != -1)
+        rgb = colors[table.glyphs[glyph].color];
+      for (int i = 0; i < scale; ++i)
+        for (auto c : rgb)
+          row[pixel++] = c;
     }
-    ret += "<br/>";
+    for (int i = 0; i < scale; ++i)
+      writer.addRow(row);
   }
-  return ret;
+  return writer.finish();
 }
@@ -2,6 +2,9 @@
 
 #include "stdafx.h"
 #include "canvas.h"
+#include "image_writer.h"
 
 void renderAscii(const LayoutCanvas::Map&, istream& file);
 string renderHtml(const LayoutCanvas::Map&, const char* renderer);
+// Draws every tile as a scale x scale square in the color of its glyph. Returns false if writing failed.
+bool renderImage(const LayoutCanvas::Map&, istream& file, const string& path, ImageFormat, int scale);
@@ -0,0 +1,83 @@
+#include "reroll.h"
+#include "generator.h"
+#include "optimizer.h"
+
+Reroll::Reroll(Rectangle area) : area(area) {}
+
+static Table<TokenList> getTiles(const LayoutCanvas::Map& map, Rectangle area) {
+  Table<TokenList> ret(area);
+  for (auto v : area)
+    ret[v] = map.elems[v];
+  return ret;
+}
+
+int Reroll::enter(const LayoutGenerator& generator, LayoutCanvas c) {
+  int index = numCalls++;
+  // Nodes are entered before their children, so on a tie the outermost one wins. Rerolling a node that doesn't
+  // draw random numbers wouldn't change anything.
+  if (c.area.contains(area) && (found.empty() || c.area.area() < found.back().area.area()) && usesRandom(generator)) {
+    int numCheckpoints = c.map->getNumCheckpoints();
+    while (!found.empty() && found.back().numCheckpoints >= numCheckpoints)
+      found.pop_back();
+    found.push_back(Found{&generator, c.area, index, numCheckpoints, getTiles(*c.map, c.area), none, none});
+  }
+  return index;
+}
+
+void Reroll::exit(int call, LayoutCanvas c) {
+  for (auto& elem : found)
+    if (elem.call == call)
+      elem.exitTiles = getTiles(*c.map, c.area);
+}
+
+void Reroll::rollback(int checkpoint) {
+  while (!found.empty() && checkpoint < found.back().numCheckpoints)
+    found.pop_back();
+}
+
+void Reroll::reset() {
+  numCalls = 0;
+  found.clear();
+}
+
+Reroll::Found* Reroll::getFound() {
+  if (found.empty() || !found.back().exitTiles)
+    return nullptr;
+  return &found.back();
+}
+
+const LayoutGenerator* Reroll::getGenerator() const {
+  return !found.empty() && found.back().exitTiles ? found.back().generator : nullptr;
+}
+
+Rectangle Reroll::getArea() const {
+  CHECK(!!getGenerator());
+  return found.back().area;
+}
+
+bool Reroll::apply(LayoutCanvas::Map& map, int seed, RandomEngine engine) {
+  auto found = getFound();
+  CHECK(!!found);
+  auto nodeArea = found->area;
+  if (!found->modifiedLater) {
+    found->modifiedLater.emplace(nodeArea);
+    for (auto v : nodeArea)
+      (*found->modifiedLater)[v] = map.elems[v] != (*found->exitTiles)[v];
+  }
+  map.reroll = nullptr;
+  auto checkpoint = map.checkpoint();
+  for (auto v : nodeArea)
+    map.modify(v) = found->entryTiles[v];
+  RandomGen random;
+  random.init(seed, engine);
+  bool ret = found->generator->make(LayoutCanvas{nodeArea, &map}, random);
+  auto rerolled = getTiles(map, nodeArea);
+  map.rollback(checkpoint);
+  if (!ret)
+    return false;
+  map.failure = nullptr;
+  for (auto v : nodeArea)
+    if (!(*found->modifiedLater)[v])
+      map.modify(v) = std::move(rerolled[v]);
+  return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "stdafx.h"
+#include "util.h"
+#include "canvas.h"
+
+struct LayoutGenerator;
+class RandomGen;
+
+// Records a generation, so that the smallest node that draws random numbers and whose area contains the given one
+// can be run again with a different seed afterwards, without running the rest of the program. Enabled by setting
+// LayoutCanvas::Map::reroll while generating.
+class Reroll {
+  public:
+  Reroll(Rectangle area);
+  // Called on entering and leaving every node. Returns the index of the call.
+  int enter(const LayoutGenerator&, LayoutCanvas);
+  void exit(int call, LayoutCanvas);
+  // Called when the map rolls back to a checkpoint. Drops the nodes that started after the checkpoint was made.
+  void rollback(int checkpoint);
+  // Forgets the last generation, before another attempt.
+  void reset();
+  // The node found in the last generation and its area, which contains the requested one. Null if there is none.
+  const LayoutGenerator* getGenerator() const;
+  Rectangle getArea() const;
+  // Runs the node again on the map that was generated, with a random stream made from the seed. The node starts
+  // from the tiles it started from the first time. Tiles that later nodes modified keep their contents, as do all
+  // tiles outside of the node's area, so the rest of the map stays the same. Nodes that read tiles outside of their
+  // area see them as they are in the generated map. Fails if the node fails, in which case the map isn't changed.
+  // Can be called again with other seeds.
+  bool apply(LayoutCanvas::Map&, int seed, RandomEngine);
+
+  private:
+  Rectangle area;
+  int numCalls = 0;
+  struct Found {
+    const LayoutGenerator* generator;
+    Rectangle area;
+    int call;
+    // The number of open checkpoints when the node started.
+    int numCheckpoints;
+    Table<TokenList> entryTiles;
+    optional<Table<TokenList>> exitTiles;
+    // Computed from exitTiles and the generated map on the first apply().
+    optional<Table<char>> modifiedLater;
+  };
+  // Smaller nodes last. An earlier node is only kept if it was inside fewer checkpoints, so that it's still there
+  // when a rollback drops the later ones.
+  vector<Found> found;
+  Found* getFound();
+};
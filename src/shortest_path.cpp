@@ -44,10 +44,20 @@ class DistanceTable {
   int counter = 1;
 };
 
-const static Rectangle maxBounds = Rectangle(500, 500);
-
-static DistanceTable distanceTable(maxBounds);
-static DirtyTable<double> navigationCostCache(maxBounds, 0);
+// Per thread, so that maps can be generated in parallel. The tables cover the largest area searched so far,
+// starting with one that fits common map sizes.
+static thread_local Rectangle tableBounds = Rectangle(500, 500);
+static thread_local DistanceTable distanceTable(tableBounds);
+static thread_local DirtyTable<double> navigationCostCache(tableBounds, 0);
+
+static void reserveTables(Rectangle area) {
+  if (!tableBounds.contains(area)) {
+    tableBounds = Rectangle(min(tableBounds.left(), area.left()), min(tableBounds.top(), area.top()),
+        max(tableBounds.right(), area.right()), max(tableBounds.bottom(), area.bottom()));
+    distanceTable = DistanceTable(tableBounds);
+    navigationCostCache = DirtyTable<double>(tableBounds, 0);
+  }
+}
 
 template <typename Fun>
 static auto getCached(Fun fun) {
@@ -71,17 +81,26 @@ ShortestPath::ShortestPath(Rectangle a, function<double(Vec2)> entryFun, functio
 template <typename EntryFun, typename LengthFun, typename DirectionsFun>
 ShortestPath::ShortestPath(TemplateConstr, Rectangle a, EntryFun entryFun, LengthFun lengthFun,
     DirectionsFun directions, Vec2 to, Vec2 from) : target(to), bounds(a) {
-  assert(maxBounds.contains(a));
+  reserveTables(a);
   navigationCostCache.clear();
   init(getCached(entryFun), lengthFun, directions, target, from);
 }
 
 ShortestPath::ShortestPath(Rectangle area, function<double (Vec2)> entryFun, function<double(Vec2)> lengthFun,
-    vector<Vec2> directions, Vec2 target, Vec2 from) : ShortestPath(area, entryFun, lengthFun,
-    [directions](Vec2) { return directions; }, target, from)
+    vector<Vec2> directions, Vec2 target, Vec2 from) : ShortestPath(TemplateConstr{}, area, entryFun, lengthFun,
+    // Returns a reference, so that the directions aren't copied for every visited tile.
+    [&directions](Vec2) -> const vector<Vec2>& { return directions; }, target, from)
 {
 }
 
+ShortestPath::ShortestPath(Rectangle a, const vector<double>& entryCost, function<double(Vec2)> lengthFun,
+    vector<Vec2> directions, Vec2 to, Vec2 from) : target(to), bounds(a) {
+  reserveTables(a);
+  CHECK(entryCost.size() == a.width() * a.height());
+  init([&] (Vec2 v) { return entryCost[(v.x - a.left()) * a.height() + v.y - a.top()]; }, lengthFun,
+      [&directions] (Vec2) -> const vector<Vec2>& { return directions; }, target, from);
+}
+
 struct QueueElem {
   Vec2 pos;
   double value;
@@ -91,30 +110,38 @@ bool inline operator < (const QueueElem& e1, const QueueElem& e2) {
   return e1.value > e2.value || (e1.value == e2.value && e1.pos < e2.pos);
 }
 
+// A heap in the same order as priority_queue<QueueElem>, kept between searches so that it doesn't have to grow
+// again every time.
+static thread_local std::vector<QueueElem> shortestPathQueue;
+
 template <typename EntryFun, typename LengthFun, typename DirectionsFun>
 void ShortestPath::init(EntryFun entryFun, LengthFun lengthFun, DirectionsFun directions,
     Vec2 target, optional<Vec2> from, optional<int> limit) {
   reversed = false;
   distanceTable.clear();
-  function<QueueElem(Vec2)> makeElem;
-  if (from)
-    makeElem = [&](Vec2 pos) ->QueueElem { return {pos, distanceTable.getDistance(pos) + lengthFun(pos)}; };
-  else
-    makeElem = [&](Vec2 pos) ->QueueElem { return {pos, distanceTable.getDistance(pos)}; };
-  priority_queue<QueueElem, vector<QueueElem>> q;
+  auto makeElem = [&](Vec2 pos) -> QueueElem {
+    return {pos, from ? distanceTable.getDistance(pos) + lengthFun(pos) : distanceTable.getDistance(pos)};
+  };
+  auto& q = shortestPathQueue;
+  q.clear();
+  auto push = [&q] (QueueElem elem) {
+    q.push_back(elem);
+    std::push_heap(q.begin(), q.end());
+  };
   distanceTable.setDistance(target, 0);
-  q.push(makeElem(target));
+  push(makeElem(target));
   int numPopped = 0;
   while (!q.empty()) {
     ++numPopped;
-    Vec2 pos = q.top().pos;
+    Vec2 pos = q.front().pos;
     double posDist = distanceTable.getDistance(pos);
    // INFO << "Popping " << pos << " " << distance[pos]  << " " << (from ? (*from - pos).length4() : 0);
     if (from == pos || (limit && distanceTable.getDistance(pos) >= *limit)) {
       constructPath(pos, directions);
       return;
     }
-    q.pop();
+    std::pop_heap(q.begin(), q.end());
+    q.pop_back();
     for (Vec2 dir : directions(pos)) {
       Vec2 next = pos + dir;
       if (next.inRectangle(bounds)) {
@@ -124,9 +151,7 @@ void ShortestPath::init(EntryFun entryFun, LengthFun lengthFun, DirectionsFun di
           assert(dist > posDist);// << "Entry fun non positive " << dist - posDist;
           if (dist < nextDist) {
             distanceTable.setDistance(next, dist);
-            {
-              q.push(makeElem(next));
-            }
+            push(makeElem(next));
           }
         }
       }
@@ -134,7 +159,8 @@ void ShortestPath::init(EntryFun entryFun, LengthFun lengthFun, DirectionsFun di
   }
 }
 
-void ShortestPath::constructPath(Vec2 pos, function<vector<Vec2>(Vec2)> directions, bool reversed) {
+template <typename DirectionsFun>
+void ShortestPath::constructPath(Vec2 pos, DirectionsFun directions, bool reversed) {
   vector<Vec2> ret;
   //auto origPos = pos;
   while (pos != target) {
@@ -193,30 +219,37 @@ Vec2 ShortestPath::getTarget() const {
   return target;
 }
 
+// The reached tiles are listed in the order of Vec2::operator <, which is also the order in which a Rectangle is
+// iterated. Scanning the bounds for them is cheaper than sorting them once they cover a good part of the bounds.
+static bool shouldScanForReached(int numReached, Rectangle bounds) {
+  return numReached * 16 >= bounds.width() * bounds.height();
+}
+
 Dijkstra::Dijkstra(Rectangle bounds, vector<Vec2> from, int maxDist, function<double(Vec2)> entryFun,
       vector<Vec2> directions) {
+  reserveTables(bounds);
+  // Thread locals are looked up on every use, so the loops below use a reference.
+  auto& distanceTable = ::distanceTable;
   distanceTable.clear();
-  auto comparator = [](Vec2 pos1, Vec2 pos2) {
-      double diff = distanceTable.getDistance(pos1) - distanceTable.getDistance(pos2);
-      if (diff > 0 || (diff == 0 && pos1 < pos2))
-        return 1;
-      else
-        return 0;};
-  priority_queue<Vec2, vector<Vec2>, decltype(comparator)> q(comparator) ;
-  for (auto& v : from) {
-    distanceTable.setDistance(v, 0);
-    q.push(v);
-  }
-  int numPopped = 0;
+  auto& q = shortestPathQueue;
+  q.clear();
+  auto push = [&q] (QueueElem elem) {
+    q.push_back(elem);
+    std::push_heap(q.begin(), q.end());
+  };
+  for (auto& v : from)
+    if (v.inRectangle(bounds) && distanceTable.getDistance(v) > 0) {
+      distanceTable.setDistance(v, 0);
+      push({v, 0});
+    }
   while (!q.empty()) {
-    ++numPopped;
-    Vec2 pos = q.top();
-    double cdist = distanceTable.getDistance(pos);
-    if (cdist > maxDist)
-      return;
-    q.pop();
-    assert(!reachable.count(pos));
-    reachable[pos] = cdist;
+    auto [pos, cdist] = q.front();
+    std::pop_heap(q.begin(), q.end());
+    q.pop_back();
+    // Tiles are pushed again when their distance drops, so skip the outdated entries.
+    if (cdist > distanceTable.getDistance(pos))
+      continue;
+    reachable.push_back(make_pair(pos, cdist));
     for (Vec2 dir : directions) {
       Vec2 next = pos + dir;
       if (next.inRectangle(bounds)) {
@@ -226,55 +259,77 @@ Dijkstra::Dijkstra(Rectangle bounds, vector<Vec2> from, int maxDist, function<do
           assert(dist > cdist);// << "Entry fun non positive " << dist - cdist;
           if (dist < ndist && dist <= maxDist) {
             distanceTable.setDistance(next, dist);
-            q.push(next);
+            push({next, dist});
           }
         }
       }
     }
   }
+  if (shouldScanForReached(reachable.size(), bounds)) {
+    reachable.clear();
+    for (auto v : bounds)
+      if (distanceTable.getDistance(v) < ShortestPath::infinity)
+        reachable.push_back(make_pair(v, distanceTable.getDistance(v)));
+  } else
+    std::sort(reachable.begin(), reachable.end(), [](const auto& e1, const auto& e2) { return e1.first < e2.first; });
+}
 
+const pair<Vec2, double>* Dijkstra::find(Vec2 pos) const {
+  auto it = std::lower_bound(reachable.begin(), reachable.end(), pos,
+      [](const auto& elem, Vec2 pos) { return elem.first < pos; });
+  return it != reachable.end() && (*it).first == pos ? &*it : nullptr;
 }
 
 bool Dijkstra::isReachable(Vec2 pos) const {
-  return reachable.count(pos);
+  return !!find(pos);
 }
 
 double Dijkstra::getDist(Vec2 v) const {
-  return reachable.at(v);
+  auto elem = find(v);
+  CHECK(!!elem);
+  return elem->second;
 }
 
 const map<Vec2, double>& Dijkstra::getAllReachable() const {
-  return reachable;
+  if (!reachableMap)
+    reachableMap.emplace(reachable.begin(), reachable.end());
+  return *reachableMap;
 }
 
 BfSearch::BfSearch(Rectangle bounds, Vec2 from, function<bool(Vec2)> entryFun, vector<Vec2> directions) {
+  if (!from.inRectangle(bounds))
+    return;
+  reserveTables(bounds);
+  auto& distanceTable = ::distanceTable;
   distanceTable.clear();
-  queue<Vec2> q;
+  // The reached tiles double as the queue.
   distanceTable.setDistance(from, 0);
-  q.push(from);
-  int numPopped = 0;
-  while (!q.empty()) {
-    ++numPopped;
-    Vec2 pos = q.front();
-    q.pop();
-    assert(!reachable.count(pos));
-    reachable.insert(pos);
+  reachable.push_back(from);
+  for (int i = 0; i < reachable.size(); ++i) {
+    Vec2 pos = reachable[i];
     for (Vec2 dir : directions) {
       Vec2 next = pos + dir;
       if (next.inRectangle(bounds) && distanceTable.getDistance(next) == ShortestPath::infinity && entryFun(next)) {
         distanceTable.setDistance(next, 0);
-        q.push(next);
+        reachable.push_back(next);
       }
     }
   }
-
+  if (shouldScanForReached(reachable.size(), bounds)) {
+    reachable.clear();
+    for (auto v : bounds)
+      if (distanceTable.getDistance(v) == 0)
+        reachable.push_back(v);
+  } else
+    std::sort(reachable.begin(), reachable.end());
 }
 
 bool BfSearch::isReachable(Vec2 pos) const {
-  return reachable.count(pos);
+  return std::binary_search(reachable.begin(), reachable.end(), pos);
 }
 
 const set<Vec2>& BfSearch::getAllReachable() const {
-  return reachable;
+  if (!reachableSet)
+    reachableSet.emplace(reachable.begin(), reachable.end());
+  return *reachableSet;
 }
-
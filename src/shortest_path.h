@@ -44,6 +44,16 @@ class ShortestPath {
       vector<Vec2> directions,
       Vec2 target,
       Vec2 from);
+
+  // Takes the entry cost of every tile of the area, column by column. The costs are read as they are, without
+  // going through the per-search cost cache.
+  ShortestPath(
+      Rectangle area,
+      const vector<double>& entryCost,
+      function<double(Vec2)> lengthFun,
+      vector<Vec2> directions,
+      Vec2 target,
+      Vec2 from);
   bool isReachable(Vec2 pos) const;
   Vec2 getNextMove(Vec2 pos);
   optional<Vec2> getNextNextMove(Vec2 pos);
@@ -56,13 +66,17 @@ class ShortestPath {
   template <typename EntryFun, typename LengthFun, typename DirectionsFun>
   void init(EntryFun entryFun, LengthFun lengthFun, DirectionsFun directions,
       Vec2 target, optional<Vec2> from, optional<int> limit = none);
-  void constructPath(Vec2 start, function<vector<Vec2>(Vec2)> directions, bool reversed = false);
+  template <typename DirectionsFun>
+  void constructPath(Vec2 start, DirectionsFun directions, bool reversed = false);
   vector<Vec2> SERIAL(path);
   Vec2 SERIAL(target);
   Rectangle SERIAL(bounds);
   bool SERIAL(reversed);
 };
 
+// Searches run in tables kept per thread. The reached tiles are then copied out, sorted by position, so that
+// queries are binary searches, and the map and set below are only built if asked for. Starting points outside the
+// bounds are ignored.
 class Dijkstra {
   public:
   Dijkstra(Rectangle bounds, vector<Vec2> from, int maxDist, function<double(Vec2)> entryFun,
@@ -72,7 +86,9 @@ class Dijkstra {
   const map<Vec2, double>& getAllReachable() const;
 
   private:
-  map<Vec2, double> reachable;
+  const pair<Vec2, double>* find(Vec2) const;
+  vector<pair<Vec2, double>> reachable;
+  mutable optional<map<Vec2, double>> reachableMap;
 };
 
 class BfSearch {
@@ -82,6 +98,7 @@ class BfSearch {
   const set<Vec2>& getAllReachable() const;
 
   private:
-  set<Vec2> reachable;
+  vector<Vec2> reachable;
+  mutable optional<set<Vec2>> reachableSet;
 };
 
@@ -0,0 +1,62 @@
+#include "streaming.h"
+#include "generator.h"
+#include "canvas.h"
+#include "optimizer.h"
+#include "map_file_writer.h"
+
+static bool addBands(const LayoutGenerator& g, Rectangle area, vector<StreamingBand>& bands) {
+  auto addSplit = [&] (const auto& split, const LayoutGenerator& first, const LayoutGenerator& second) {
+    auto areas = getSplitAreas(split, area);
+    return addBands(first, areas.first, bands) && addBands(second, areas.second, bands);
+  };
+  if (auto split = g.getReferenceMaybe<LayoutGenerators::SplitH>())
+    return addSplit(*split, *split->left, *split->right);
+  if (auto split = g.getReferenceMaybe<LayoutGenerators::SplitV>())
+    return addSplit(*split, *split->top, *split->bottom);
+  if (auto chain = g.getReferenceMaybe<LayoutGenerators::Chain>())
+    if (chain->generators.size() == 1)
+      return addBands(chain->generators[0], area, bands);
+  if (!isLocal(g))
+    return false;
+  bands.push_back(StreamingBand{area, &g});
+  return true;
+}
+
+optional<vector<StreamingBand>> getStreamingBands(const LayoutGenerator& g, Rectangle area) {
+  vector<StreamingBand> ret;
+  if (!addBands(g, area, ret))
+    return none;
+  return ret;
+}
+
+// Position can run its generator on an area larger than its own, when the chosen size doesn't fit.
+static bool wroteOutside(const LayoutCanvas::Map& map, Rectangle area) {
+  bool ret = false;
+  map.elems.forEachAllocatedChunk([&] (Rectangle chunk) {
+    for (auto v : chunk)
+      if (!v.inRectangle(area) && !map.elems[v].empty())
+        ret = true;
+  });
+  return ret;
+}
+
+optional<string> generateStreaming(const vector<StreamingBand>& bands, Vec2 size, int seed, RandomEngine engine,
+    MapFileWriter& writer) {
+  RandomGen random;
+  random.init(seed, engine);
+  for (auto& band : bands) {
+    // The map covers the whole world so that the coordinates are the same as in a full run, but only the chunks
+    // that the band writes are allocated.
+    LayoutCanvas::Map map(ChunkedTable<TokenList>(size.x, size.y));
+    if (!band.generator->make(LayoutCanvas{band.area, &map}, random))
+      return string("Generation failed.");
+    if (wroteOutside(map, band.area))
+      return string("The program writes outside of its top-level splits and can't be streamed.");
+    writer.addBand(map.elems, band.area);
+    if (!writer.good())
+      return string("Failed to write the output file.");
+  }
+  if (!writer.finish())
+    return string("Failed to write the output file.");
+  return none;
+}
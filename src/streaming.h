@@ -0,0 +1,22 @@
+#pragma once
+
+#include "stdafx.h"
+#include "util.h"
+
+struct LayoutGenerator;
+class MapFileWriter;
+
+struct StreamingBand {
+  Rectangle area;
+  const LayoutGenerator* generator;
+};
+
+// Splits a program whose top level is a tree of SplitH and SplitV nodes into the parts that its leaves run on, in
+// the order they run. Returns none unless every leaf is local, because then the leaves can be generated one at a
+// time, each on an otherwise empty map.
+optional<vector<StreamingBand>> getStreamingBands(const LayoutGenerator&, Rectangle area);
+
+// Generates the map band by band and writes each band as soon as it's done, so that memory use is bounded by the
+// largest band. The result is the same as generating the whole map with the same seed.
+// Returns an error message on failure.
+optional<string> generateStreaming(const vector<StreamingBand>&, Vec2 size, int seed, RandomEngine, MapFileWriter&);
@@ -0,0 +1,17 @@
+#include "token.h"
+
+static const string* intern(const string& s) {
+  static std::mutex mutex;
+  static std::unordered_set<string> names;
+  std::lock_guard<std::mutex> lock(mutex);
+  return &*names.insert(s).first;
+}
+
+Token::Token() {
+  static const string* empty = intern("");
+  name = empty;
+}
+
+Token::Token(const string& s) : name(intern(s)) {}
+
+Token::Token(const char* s) : name(intern(s)) {}
@@ -3,4 +3,56 @@
 
 #include "stdafx.h"
 
-using Token = string;
+// Tokens are interned, so that they are copied and compared as a single pointer. Interned names are never freed.
+class Token {
+  public:
+  Token();
+  Token(const string&);
+  Token(const char*);
+
+  const string& getName() const {
+    return *name;
+  }
+
+  bool operator == (const Token& o) const {
+    return name == o.name;
+  }
+
+  bool operator != (const Token& o) const {
+    return name != o.name;
+  }
+
+  // Compares the names, so that the order doesn't depend on when the tokens were interned.
+  bool operator < (const Token& o) const {
+    return *name < *o.name;
+  }
+
+  size_t getHash() const {
+    return std::hash<const string*>()(name);
+  }
+
+  template <class Archive>
+  void serialize(Archive& ar1) {
+    string s;
+    ar1(s);
+    *this = Token(s);
+  }
+
+  private:
+  const string* name;
+};
+
+inline ostream& operator << (ostream& o, const Token& t) {
+  return o << t.getName();
+}
+
+namespace std {
+template <> struct hash<Token> {
+  size_t operator()(const Token& t) const {
+    return t.getHash();
+  }
+};
+}
+
+// Contents of a single map tile. Most tiles hold only a few tokens, so they don't allocate.
+using TokenList = small_vector<Token, 4>;
@@ -0,0 +1,54 @@
+#include "umg.h"
+#include "optimizer.h"
+#include "umg_include.h"
+
+namespace umg {
+
+// The nodes are released while their arena is still alive, and only then the arena is replaced.
+Program& Program::operator = (Program&& other) {
+  generator = std::move(other.generator);
+  arena = std::move(other.arena);
+  return *this;
+}
+
+const LayoutGenerator& Program::getGenerator() const {
+  return generator;
+}
+
+Program compile(const vector<string>& sources, const vector<string>& filenames) {
+  Program ret;
+  LayoutGenerator gen;
+  vector<string> inputs {string(umgInclude)};
+  inputs.append(sources);
+  vector<string> names {"include.umg"};
+  names.append(filenames);
+  PrettyInputArchive ar(inputs, names, nullptr);
+  ar(gen);
+  ret.generator = optimize(gen, ret.arena);
+  return ret;
+}
+
+GenerationContext::GenerationContext(RandomEngine engine) : engine(engine) {
+}
+
+const LayoutCanvas::Map& GenerationContext::getMap() const {
+  return *map;
+}
+
+void GenerationContext::reset(int width, int height) {
+  CHECK(width > 0 && height > 0);
+  if (map && map->elems.getBounds() == Rectangle(width, height))
+    map->reset();
+  else {
+    map.reset();
+    map.emplace(ChunkedTable<TokenList>(width, height));
+  }
+}
+
+bool generate(const Program& program, GenerationContext& context, int width, int height, int seed) {
+  context.random.init(seed, context.engine);
+  context.reset(width, height);
+  return program.getGenerator().make(LayoutCanvas{context.map->elems.getBounds(), &*context.map}, context.random);
+}
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "stdafx.h"
+#include "util.h"
+#include "generator.h"
+#include "canvas.h"
+
+// Interface for embedding the generator in other programs, built as libumg by the Makefile.
+namespace umg {
+
+// A parsed and optimized program. Its nodes are kept in its own arena.
+class Program {
+  public:
+  Program(Program&&) = default;
+  Program& operator = (Program&&);
+  const LayoutGenerator& getGenerator() const;
+
+  private:
+  friend Program compile(const vector<string>&, const vector<string>&);
+  Program() {}
+  // Declared first, so that it's destroyed after the nodes.
+  Arena arena;
+  LayoutGenerator generator;
+};
+
+// The sources are read after the standard include, as if they were one file. The file names are only used in
+// error messages. Throws PrettyException if the program doesn't parse.
+Program compile(const vector<string>& sources, const vector<string>& filenames = {});
+
+// Everything that is kept between generations. Generating maps of the same size again reuses the map's memory and
+// scratch buffers. Pathfinding tables are kept per thread, so they are reused regardless.
+class GenerationContext {
+  public:
+  GenerationContext(RandomEngine = RandomEngine::COMPATIBLE);
+  // The map made by the last call to generate. Only valid if it succeeded.
+  const LayoutCanvas::Map& getMap() const;
+  // Empties the map for a generation of the given size, keeping its memory if the size didn't change. Called by
+  // generate, so one context can be kept for many maps.
+  void reset(int width, int height);
+
+  private:
+  friend bool generate(const Program&, GenerationContext&, int, int, int);
+  RandomEngine engine;
+  RandomGen random;
+  optional<LayoutCanvas::Map> map;
+};
+
+// Returns false if the program failed.
+bool generate(const Program&, GenerationContext&, int width, int height, int seed);
+
+}
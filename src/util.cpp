@@ -1,6 +1,22 @@
 #include "util.h"
 #include "pretty_archive.h"
 
+// Blocks double in size, so a program takes a logarithmic number of them.
+const size_t minArenaBlockSize = 1 << 14;
+
+void* Arena::allocate(size_t size, size_t alignment) {
+  blockUsed = (blockUsed + alignment - 1) / alignment * alignment;
+  if (blocks.empty() || blockUsed + size > blockSize) {
+    blockSize = max(max(minArenaBlockSize, 2 * blockSize), size);
+    // operator new[] returns memory aligned for any fundamental type.
+    blocks.push_back(unique_ptr<char[]>(new char[blockSize]));
+    blockUsed = 0;
+  }
+  auto ret = blocks.back().get() + blockUsed;
+  blockUsed += size;
+  return ret;
+}
+
 
 Rectangle::Rectangle(int _w, int _h) : px(0), py(0), kx(_w), ky(_h), w(_w), h(_h) {
   if (w <= 0 || h <= 0) {
@@ -106,6 +122,14 @@ bool Rectangle::intersects(const Rectangle& other) const {
   return max(px, other.px) < min(kx, other.kx) && max(py, other.py) < min(ky, other.ky);
 }
 
+bool Rectangle::operator == (const Rectangle& other) const {
+  return px == other.px && py == other.py && kx == other.kx && ky == other.ky;
+}
+
+bool Rectangle::operator != (const Rectangle& other) const {
+  return !(*this == other);
+}
+
 bool Rectangle::contains(const Rectangle& other) const {
   return px <= other.px && py <= other.py && kx >= other.kx && ky >= other.ky;
 }
@@ -490,11 +514,71 @@ void Vec2::serialize(PrettyInputArchive& ar, const unsigned int version) {
   ar(NAMED(x), NAMED(y));
 }
 
+void Xoshiro256::seed(result_type seed) {
+  for (auto& s : state) {
+    seed += 0x9e3779b97f4a7c15ull;
+    auto z = seed;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    s = z ^ (z >> 31);
+  }
+}
+
+static unsigned long long rotateLeft(unsigned long long x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+Xoshiro256::result_type Xoshiro256::operator()() {
+  auto ret = rotateLeft(state[0] + state[3], 23) + state[0];
+  auto t = state[1] << 17;
+  state[2] ^= state[0];
+  state[3] ^= state[1];
+  state[1] ^= state[2];
+  state[0] ^= state[3];
+  state[2] ^= t;
+  state[3] = rotateLeft(state[3], 45);
+  return ret;
+}
+
 RandomGen::RandomGen() {
 }
 
-void RandomGen::init(int seed) {
-  generator.seed(seed);
+void RandomGen::init(int seed, RandomEngine e) {
+  engine = e;
+  if (engine == RandomEngine::FAST) {
+    fastGenerator.seed(seed);
+    generator.reset();
+  } else if (generator)
+    generator->seed(seed);
+  else
+    generator = unique<std::mt19937>(seed);
+}
+
+std::mt19937& RandomGen::getGenerator() {
+  if (!generator)
+    generator = unique<std::mt19937>();
+  return *generator;
+}
+
+// Lemire, "Fast Random Integer Generation in an Interval", 2019.
+unsigned RandomGen::getBounded(unsigned range) {
+  auto m = (unsigned long long) (unsigned) (fastGenerator() >> 32) * range;
+  if ((unsigned) m < range) {
+    unsigned threshold = -range % range;
+    while ((unsigned) m < threshold)
+      m = (unsigned long long) (unsigned) (fastGenerator() >> 32) * range;
+  }
+  return m >> 32;
+}
+
+unsigned long long RandomGen::getBounded(unsigned long long range) {
+  auto m = (unsigned __int128) fastGenerator() * range;
+  if ((unsigned long long) m < range) {
+    auto threshold = -range % range;
+    while ((unsigned long long) m < threshold)
+      m = (unsigned __int128) fastGenerator() * range;
+  }
+  return m >> 64;
 }
 
 int RandomGen::get(int max) {
@@ -502,7 +586,9 @@ int RandomGen::get(int max) {
 }
 
 long long RandomGen::getLL() {
-  return uniform_int_distribution<long long>(-(1LL << 62), 1LL << 62)(generator);
+  if (engine == RandomEngine::FAST)
+    return -(1LL << 62) + (long long) getBounded((1ULL << 63) + 1);
+  return uniform_int_distribution<long long>(-(1LL << 62), 1LL << 62)(getGenerator());
 }
 
 int RandomGen::get(Range r) {
@@ -511,7 +597,9 @@ int RandomGen::get(Range r) {
 
 int RandomGen::get(int min, int max) {
   assert(max > min);
-  return uniform_int_distribution<int>(min, max - 1)(generator);
+  if (engine == RandomEngine::FAST)
+    return int(unsigned(min) + getBounded(unsigned(max) - unsigned(min)));
+  return uniform_int_distribution<int>(min, max - 1)(getGenerator());
 }
 
 
@@ -530,6 +618,81 @@ int RandomGen::get(const vector<double>& weights) {
   return weights.size() - 1;
 }
 
+CumulativeWeights::CumulativeWeights(const vector<double>& weights) {
+  double sum = 0;
+  for (double elem : weights) {
+    sum += elem;
+    increasing &= elem >= 0;
+    sums.push_back(sum);
+  }
+  if (!increasing || sum <= 0)
+    return;
+  // Vose, "A linear algorithm for generating random numbers with a given distribution", 1991.
+  int size = weights.size();
+  vector<double> scaled;
+  vector<int> small;
+  vector<int> large;
+  for (int i : All(weights)) {
+    probabilities.push_back(1);
+    aliases.push_back(i);
+    scaled.push_back(weights[i] * size / sum);
+    (scaled[i] < 1 ? small : large).push_back(i);
+  }
+  while (!small.empty() && !large.empty()) {
+    int less = small.back();
+    small.pop_back();
+    int more = large.back();
+    probabilities[less] = scaled[less];
+    aliases[less] = more;
+    scaled[more] -= 1 - scaled[less];
+    if (scaled[more] < 1) {
+      large.pop_back();
+      small.push_back(more);
+    }
+  }
+  // Whatever is left is 1 up to rounding errors, and keeps the probability of 1.
+}
+
+bool CumulativeWeights::empty() const {
+  return sums.empty();
+}
+
+int RandomGen::get(const CumulativeWeights& weights) {
+  auto& sums = weights.sums;
+  assert(!sums.empty() && sums.back() > 0);
+  if (engine == RandomEngine::FAST && !weights.probabilities.empty()) {
+    int index = get(sums.size());
+    return getDouble() < weights.probabilities[index] ? index : weights.aliases[index];
+  }
+  double r = getDouble(0, sums.back());
+  if (!weights.increasing) {
+    for (int i : All(sums))
+      if (sums[i] >= r)
+        return i;
+    return sums.size() - 1;
+  }
+  // The first index with sums[index] >= r.
+  int low = 0;
+  int high = sums.size() - 1;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (sums[mid] >= r)
+      high = mid;
+    else
+      low = mid + 1;
+  }
+  return low;
+}
+
+int RandomGen::getIndex(int size) {
+  assert(size > 0);
+  if (engine == RandomEngine::FAST)
+    return get(size);
+  // With unit weights the linear scan in get(weights) stops at the first i with i + 1 >= r.
+  double r = getDouble(0, size);
+  return min(size - 1, max(0, int(ceil(r)) - 1));
+}
+
 bool RandomGen::roll(int chance) {
   return get(chance) == 0;
 }
@@ -539,9 +702,13 @@ bool RandomGen::chance(double v) {
 }
 
 double RandomGen::getDouble() {
-  return defaultDist(generator);
+  if (engine == RandomEngine::FAST)
+    return (fastGenerator() >> 11) * 0x1.0p-53;
+  return defaultDist(getGenerator());
 }
 
 double RandomGen::getDouble(double a, double b) {
-  return uniform_real_distribution<double>(a, b)(generator);
+  if (engine == RandomEngine::FAST)
+    return a + (b - a) * getDouble();
+  return uniform_real_distribution<double>(a, b)(getGenerator());
 }
@@ -16,6 +16,43 @@ string toString(const T& t) {
   return ss.str();
 }
 
+// Bump allocator that owns the nodes of an optimized program, see optimize(const LayoutGenerator&, Arena&). Nodes are
+// only placed in it by moveToArena(), everything else allocates them on the heap. Destructors still run, but the
+// memory is released all at once when the arena is destroyed, so it must outlive the nodes placed in it.
+class Arena {
+  public:
+  Arena() {}
+  Arena(const Arena&) = delete;
+  Arena(Arena&&) = default;
+  Arena& operator = (Arena&&) = default;
+  void* allocate(size_t size, size_t alignment);
+
+  private:
+  vector<unique_ptr<char[]>> blocks;
+  size_t blockUsed = 0;
+  size_t blockSize = 0;
+};
+
+template <class T>
+struct ArenaDeleter {
+  bool inArena = false;
+  void operator()(T* t) const {
+    if (inArena)
+      t->~T();
+    else
+      delete t;
+  }
+};
+
+// Owns a node that is either on the heap or in an Arena.
+template <class T>
+using arena_ptr = unique_ptr<T, ArenaDeleter<T>>;
+
+template <class T>
+arena_ptr<T> moveToArena(Arena& arena, T&& t) {
+  return arena_ptr<T>(new (arena.allocate(sizeof(T), alignof(T))) T(std::move(t)), ArenaDeleter<T>{true});
+}
+
 template <class T>
 class HeapAllocated {
   public:
@@ -55,6 +92,11 @@ class HeapAllocated {
     elem.reset(new T(std::move(t)));
   }
 
+  // Copies made later are on the heap again.
+  void moveToArena(Arena& arena) {
+    elem = ::moveToArena(arena, std::move(*elem));
+  }
+
   HeapAllocated& operator = (const HeapAllocated& t) {
     *elem.get() = *t;
     return *this;
@@ -72,7 +114,7 @@ class HeapAllocated {
   template <class Archive>
   void serialize(Archive& ar1) {
     if (!elem && Archive::is_loading::value) {
-      elem = unique<T>();
+      elem.reset(new T());
     }
     assert(!!elem);
     ar1(*elem);
@@ -87,7 +129,7 @@ class HeapAllocated {
 #endif
 
   protected:
-  unique_ptr<T> elem;
+  arena_ptr<T> elem;
 };
 
 template <class T> constexpr bool isOneOf(const T& value) {
@@ -382,17 +424,183 @@ class Table {
   unique_ptr<T[]> mem;
 };
 
+// Table split into square chunks that are allocated on the first write, so that memory is proportional to the
+// written area. Unwritten tiles read as the fill value. Tiles are only written through modify().
+template <class T>
+class ChunkedTable {
+  public:
+  static constexpr int chunkBits = 5;
+  static constexpr int chunkSize = 1 << chunkBits;
+
+  ChunkedTable(const Rectangle& rect, const T& fill = T()) : bounds(rect), px(rect.left()), py(rect.top()),
+      fill(fill), chunksH((rect.height() + chunkSize - 1) >> chunkBits),
+      chunks(((rect.width() + chunkSize - 1) >> chunkBits) * chunksH) {
+  }
+
+  ChunkedTable(int w, int h, const T& fill = T()) : ChunkedTable(Rectangle(w, h), fill) {
+  }
+
+  ChunkedTable(Vec2 size, const T& fill = T()) : ChunkedTable(size.x, size.y, fill) {
+  }
+
+  ChunkedTable(ChunkedTable&&) noexcept = default;
+  ChunkedTable& operator = (ChunkedTable&&) noexcept = default;
+
+  ChunkedTable(const ChunkedTable& t) : bounds(t.bounds), px(t.px), py(t.py), fill(t.fill), chunksH(t.chunksH),
+      chunks(t.chunks.size()) {
+    for (int i = 0; i < t.chunks.size(); ++i)
+      if (t.chunks[i]) {
+        chunks[i].reset(new T[chunkSize * chunkSize]);
+        for (int j : Range(chunkSize * chunkSize))
+          chunks[i][j] = t.chunks[i][j];
+      }
+  }
+
+  ChunkedTable& operator = (const ChunkedTable& t) {
+    *this = ChunkedTable(t);
+    return *this;
+  }
+
+  const Rectangle& getBounds() const {
+    return bounds;
+  }
+
+  const T& operator[](const Vec2& v) const {
+    assert(v.inRectangle(bounds));
+    auto& chunk = chunks[getChunkIndex(v)];
+    if (!chunk)
+      return fill;
+    return chunk[getIndexInChunk(v)];
+  }
+
+  T& modify(const Vec2& v) {
+    assert(v.inRectangle(bounds));
+    auto& chunk = chunks[getChunkIndex(v)];
+    if (!chunk)
+      allocateChunk(chunk);
+    return chunk[getIndexInChunk(v)];
+  }
+
+  // Sets every tile back to the fill value. Allocated chunks are kept, so that refilling the table doesn't
+  // allocate again.
+  void reset() {
+    for (auto& chunk : chunks)
+      if (chunk)
+        for (int i = 0; i < chunkSize * chunkSize; ++i)
+          chunk[i] = fill;
+  }
+
+  int getNumAllocatedChunks() const {
+    int ret = 0;
+    for (auto& chunk : chunks)
+      if (chunk)
+        ++ret;
+    return ret;
+  }
+
+  // Calls fun with the area covered by every allocated chunk.
+  template <typename Fun>
+  void forEachAllocatedChunk(Fun fun) const {
+    for (int i = 0; i < chunks.size(); ++i)
+      if (chunks[i]) {
+        Vec2 corner(px + (i / chunksH) * chunkSize, py + (i % chunksH) * chunkSize);
+        fun(Rectangle(corner, corner + Vec2(chunkSize, chunkSize)).intersection(bounds));
+      }
+  }
+
+  // Calls fun with every part of the area that lies within a single chunk. Iterating the parts in order visits each
+  // chunk once, instead of once per column of the area.
+  template <typename Fun>
+  void forEachChunk(Rectangle area, Fun fun) const {
+    area = area.intersection(bounds);
+    if (area.empty())
+      return;
+    for (int x = area.left(); x < area.right(); x = getChunkEnd(x, px))
+      for (int y = area.top(); y < area.bottom(); y = getChunkEnd(y, py))
+        fun(Rectangle(x, y, min(area.right(), getChunkEnd(x, px)), min(area.bottom(), getChunkEnd(y, py))));
+  }
+
+  private:
+  void allocateChunk(unique_ptr<T[]>& chunk) {
+    chunk.reset(new T[chunkSize * chunkSize]);
+    for (int i = 0; i < chunkSize * chunkSize; ++i)
+      chunk[i] = fill;
+  }
+
+  static int getChunkEnd(int coord, int origin) {
+    return origin + (((coord - origin) >> chunkBits) + 1) * chunkSize;
+  }
+
+  int getChunkIndex(const Vec2& v) const {
+    return ((v.x - px) >> chunkBits) * chunksH + ((v.y - py) >> chunkBits);
+  }
+
+  int getIndexInChunk(const Vec2& v) const {
+    return (((v.x - px) & (chunkSize - 1)) << chunkBits) + ((v.y - py) & (chunkSize - 1));
+  }
+
+  Rectangle bounds;
+  // Copies of the bounds' corner, because the Rectangle accessors aren't inline.
+  int px;
+  int py;
+  T fill;
+  int chunksH;
+  std::vector<unique_ptr<T[]>> chunks;
+};
+
+// Weights prepared once for repeated sampling with RandomGen::get. With the COMPATIBLE engine sampling draws the same
+// number and returns the same index as RandomGen::get(const vector<double>&), through a binary search over the prefix
+// sums, so it takes O(log n). The FAST engine uses Vose's alias table instead, which takes O(1).
+class CumulativeWeights {
+  public:
+  CumulativeWeights() {}
+  CumulativeWeights(const vector<double>& weights);
+  bool empty() const;
+
+  private:
+  friend class RandomGen;
+  vector<double> sums;
+  // Negative weights make the sums decrease, and then neither the binary search nor the alias table can be used.
+  bool increasing = true;
+  // Index i is picked with the given probability, otherwise its alias is.
+  vector<double> probabilities;
+  vector<int> aliases;
+};
+
+// xoshiro256++ by Blackman and Vigna, seeded through splitmix64. Satisfies UniformRandomBitGenerator.
+class Xoshiro256 {
+  public:
+  using result_type = unsigned long long;
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return ~result_type(0); }
+  void seed(result_type);
+  result_type operator()();
+
+  private:
+  result_type state[4];
+};
+
+enum class RandomEngine {
+  // std::mt19937 with the standard distributions. Existing seeds keep generating the same maps.
+  COMPATIBLE,
+  // Xoshiro256 with Lemire's range reduction. Much faster and smaller, but gives different maps for the same seed.
+  FAST
+};
+
 class RandomGen {
   public:
   RandomGen();
   RandomGen(const RandomGen&) = delete;
   RandomGen(RandomGen&&) = default;
-  void init(int seed);
+  void init(int seed, RandomEngine = RandomEngine::COMPATIBLE);
   int get(int max);
   long long getLL();
   int get(int min, int max);
   int get(Range);
   int get(const vector<double>& weights);
+  int get(const CumulativeWeights&);
+  // Same as get(vector<double>(size, 1)) without building the weights.
+  int getIndex(int size);
   double getDouble();
   double getDouble(double a, double b);
   pair<float, float> getFloat2Fast();
@@ -409,8 +617,7 @@ class RandomGen {
 
   template <typename T>
   T choose(const vector<T>& v) {
-    vector<double> pi(v.size(), 1);
-    return choose(v, pi);
+    return v[getIndex(v.size())];
   }
 
   template <typename T>
@@ -421,22 +628,17 @@ class RandomGen {
 
   template <typename T>
   T choose(vector<T>&& v) {
-    vector<double> pi(v.size(), 1);
-    return choose(std::move(v), pi);
+    return std::move(v[getIndex(v.size())]);
   }
 
   template <typename T>
   T choose(const set<T>& vi) {
-    vector<T> v(vi.size());
-    std::copy(vi.begin(), vi.end(), v.begin());
-    return choose(v);
+    return *std::next(vi.begin(), getIndex(vi.size()));
   }
 
   template <typename T, typename Hash>
   T choose(const unordered_set<T, Hash>& vi) {
-    vector<T> v(vi.size());
-    std::copy(vi.begin(), vi.end(), v.begin());
-    return choose(v);
+    return *std::next(vi.begin(), getIndex(vi.size()));
   }
 
   template <typename T>
@@ -468,13 +670,16 @@ class RandomGen {
 
   template <typename T>
   vector<T> permutation(vector<T> v) {
-    std::shuffle(v.begin(), v.end(), generator);
+    shuffle(v.begin(), v.end());
     return v;
   }
 
   template <typename Iterator>
   void shuffle(Iterator begin, Iterator end) {
-    std::shuffle(begin, end, generator);
+    if (engine == RandomEngine::FAST)
+      std::shuffle(begin, end, fastGenerator);
+    else
+      std::shuffle(begin, end, getGenerator());
   }
 
   template <typename T>
@@ -524,8 +729,16 @@ class RandomGen {
   }
 
   private:
-  std::mt19937 generator;
+  RandomEngine engine = RandomEngine::COMPATIBLE;
+  // Only allocated for COMPATIBLE, since its state takes 2.5KB. Created with the default seed on the first draw if
+  // init wasn't called.
+  unique_ptr<std::mt19937> generator;
+  std::mt19937& getGenerator();
   std::uniform_real_distribution<double> defaultDist;
+  Xoshiro256 fastGenerator;
+  // Uniform in [0, range), without modulo bias.
+  unsigned getBounded(unsigned range);
+  unsigned long long getBounded(unsigned long long range);
 
   template <typename T>
   T&& chooseImpl(T&& cur, int total) {
@@ -671,19 +884,24 @@ class heap_optional {
     elem.reset();
   }
 
+  void moveToArena(Arena& arena) {
+    if (elem)
+      elem = ::moveToArena(arena, std::move(*elem));
+  }
+
   heap_optional& operator = (const T& t) {
-    elem = unique<T>(t);
+    elem.reset(new T(t));
     return *this;
   }
 
   heap_optional& operator = (T&& t) noexcept {
-    elem = unique<T>(std::move(t));
+    elem.reset(new T(std::move(t)));
     return *this;
   }
 
   heap_optional& operator = (const heap_optional& t) noexcept {
     if (t.elem)
-      elem = unique<T>(*t.elem);
+      elem.reset(new T(*t.elem));
     else
       clear();
     return *this;
@@ -708,5 +926,5 @@ class heap_optional {
   SERIALIZE_ALL(elem)
 
   private:
-  unique_ptr<T> SERIAL(elem);
+  arena_ptr<T> SERIAL(elem);
 };
@@ -0,0 +1,310 @@
+#include "src/umg.h"
+#include "src/map_file_writer.h"
+#include "src/map_file_reader.h"
+#include "src/shortest_path.h"
+#include "src/streaming.h"
+#include "src/generation_driver.h"
+#include "src/reroll.h"
+
+// Regression tests for the library. Each one aborts through CHECK if it fails. Build with ASAN=1 to also catch
+// memory errors.
+
+static const char* program = "{ Reset(\"wall\") Inside(1, { Reset(\"floor\") Filter(Chance(0.1), Set(\"table\")) }) }";
+
+// Assigning a program destroys the old nodes while their arena is still alive.
+static void testProgramAssignment() {
+  auto p = umg::compile({program});
+  umg::GenerationContext context;
+  CHECK(umg::generate(p, context, 20, 20, 1));
+  p = umg::compile({program});
+  CHECK(umg::generate(p, context, 20, 20, 1));
+  auto moved = std::move(p);
+  CHECK(umg::generate(moved, context, 20, 20, 1));
+}
+
+// Pushing one of the vector's own elements when it has to grow.
+static void testSmallVectorSelfPush() {
+  small_vector<int, 2> v {1, 2};
+  v.push_back(v[0]);
+  v.push_front(v[2]);
+  for (int i = 0; i < 10; ++i)
+    v.push_back(v[i]);
+  v.push_front(v[v.size() - 1]);
+  CHECK(v.size() == 15);
+  vector<int> expected {1, 1, 1, 2, 1, 1, 1, 2, 1, 1, 1, 2, 1, 1, 1};
+  for (int i = 0; i < v.size(); ++i)
+    CHECK(v[i] == expected[i]);
+}
+
+// Points on either side of an impassable wall fail the Connect, whichever search is used.
+static void testConnectUnreachable() {
+  for (string search : {"EXACT", "HIERARCHICAL"}) {
+    auto p = umg::compile({"{ Reset(\"floor\") "
+        "Position(position = MIDDLE, size = {2, 20}, generator = Reset(\"wall\")) "
+        "Connect(On(\"floor\"), (1, On(\"floor\"), {}), (none, On(\"wall\"), {}), search = " + search + ") }"});
+    umg::GenerationContext context;
+    CHECK(!umg::generate(p, context, 20, 20, 1));
+  }
+}
+
+// A stamped Position that doesn't fit its area writes outside of it, so it isn't stamped.
+static void testStampPositionOutside() {
+  auto p = umg::compile({"{ Reset(\"grass\") Inside(3, Place(size = {3, 3}, count = 3, minSpacing = 3, "
+      "generator = Position(position = MIDDLE, size = {5, 5}, generator = Set(\"x\")))) }"});
+  umg::GenerationContext context;
+  CHECK(umg::generate(p, context, 20, 20, 1));
+  int numSet = 0;
+  for (auto v : Rectangle(20, 20))
+    if (context.getMap().elems[v].contains(Token("x")))
+      ++numSet;
+  CHECK(numSet > 9);
+}
+
+// Rerolling changes only the rerolled node's area, and survives an inner node being rolled back.
+static void testReroll() {
+  auto p = umg::compile({"{ Reset(\"floor\") Place(size = {4, 6}, count = 8, generator = Try({ "
+      "Filter(Chance(0.3), Set(\"x\")) Retry(0, {}) })) }"});
+  Vec2 size(30, 30);
+  int numApplied = 0;
+  for (int seed : Range(1, 6)) {
+    Reroll reroll(Rectangle(10, 10, 12, 12));
+    auto result = generateWithRetries(p.getGenerator(), size, seed, RandomEngine::FAST, GenerationBudget{}, nullptr,
+        &reroll);
+    CHECK(!!result.map && !!reroll.getGenerator());
+    auto area = reroll.getArea();
+    CHECK(area.contains(Rectangle(10, 10, 12, 12)));
+    auto& map = *result.map;
+    Table<TokenList> generated{Rectangle(size)};
+    for (auto v : Rectangle(size))
+      generated[v] = map.elems[v];
+    if (!reroll.apply(map, seed + 100, RandomEngine::FAST))
+      continue;
+    ++numApplied;
+    for (auto v : Rectangle(size))
+      if (!v.inRectangle(area))
+        CHECK(map.elems[v] == generated[v]);
+  }
+  CHECK(numApplied > 0);
+}
+
+static bool compiles(const string& program) {
+  try {
+    umg::compile({program});
+    return true;
+  } catch (PrettyException&) {
+    return false;
+  }
+}
+
+// Positional values can only be followed by the metric option, other fields are either all positional or all named.
+static void testPositionalMetric() {
+  CHECK(compiles("Filter(Distance(0, 3, On(\"x\"), metric = CHEBYSHEV), Set(\"y\"))"));
+  CHECK(compiles("Filter(Distance(min = 0, max = 3, predicate = On(\"x\"), metric = CHEBYSHEV), Set(\"y\"))"));
+  CHECK(compiles("DistanceField(On(\"x\"), { (0, 2, Set(\"y\")) }, metric = CHEBYSHEV)"));
+  CHECK(!compiles("Filter(Distance(0, 3, predicate = On(\"x\")), Set(\"y\"))"));
+  CHECK(!compiles("Filter(Distance(0, 3, On(\"x\"), metric = CHEBYSHEV, max = 4), Set(\"y\"))"));
+  CHECK(!compiles("Position(MIDDLE, size = {2, 2}, generator = Set(\"y\"))"));
+}
+
+// A RandomGen that was never initialized draws from a default seeded std::mt19937.
+static void testRandomWithoutInit() {
+  RandomGen random;
+  std::mt19937 expected;
+  for (int i : Range(10))
+    CHECK(random.get(1000) == std::uniform_int_distribution<int>(0, 999)(expected));
+}
+
+// Prepared weights pick the same elements as plain ones with the COMPATIBLE engine, and with the alias table used by
+// FAST they're picked about as often as their weights say.
+static void testCumulativeWeights() {
+  vector<double> weights {1, 2, 0, 5};
+  CumulativeWeights prepared(weights);
+  RandomGen random1;
+  RandomGen random2;
+  random1.init(7);
+  random2.init(7);
+  for (int i : Range(1000))
+    CHECK(random1.get(prepared) == random2.get(weights));
+  random1.init(7, RandomEngine::FAST);
+  int numDraws = 80000;
+  vector<int> counts(weights.size(), 0);
+  for (int i : Range(numDraws))
+    ++counts[random1.get(prepared)];
+  CHECK(counts[2] == 0);
+  for (int i : All(weights))
+    CHECK(fabs(counts[i] - numDraws * weights[i] / 8) < numDraws / 100);
+}
+
+// A map written in bands, as when streaming, reads back the same through the tiles and the bitplanes.
+static void testMapFileBands() {
+  auto p = umg::compile({program});
+  umg::GenerationContext context;
+  CHECK(umg::generate(p, context, 20, 30, 1));
+  auto& map = context.getMap();
+  const char* path = "umgl_test_map.bin";
+  MapFileWriter writer(path, Vec2(20, 30), true);
+  writer.addBand(map.elems, Rectangle(0, 0, 20, 13));
+  writer.addBand(map.elems, Rectangle(0, 13, 8, 30));
+  writer.addBand(map.elems, Rectangle(8, 13, 20, 30));
+  CHECK(writer.finish());
+  {
+    MapFileReader reader(path);
+    CHECK(reader.good() && reader.hasBitplanes());
+    CHECK(reader.getTile(20, 0).size() == 0 && reader.getTile(0, -1).size() == 0);
+    for (int id : Range(reader.getNumTokens()))
+      CHECK(reader.findToken(reader.getTokenName(id)) == id);
+    for (auto v : map.elems.getBounds()) {
+      vector<string> tokens;
+      for (auto id : reader.getTile(v.x, v.y))
+        tokens.push_back(string(reader.getTokenName(id)));
+      CHECK(tokens.size() == map.elems[v].size());
+      for (int i : All(tokens))
+        CHECK(tokens[i] == map.elems[v][i].getName());
+      for (int id : Range(reader.getNumTokens()))
+        CHECK(reader.contains(v.x, v.y, id) == tokens.contains(string(reader.getTokenName(id))));
+    }
+  }
+  std::remove(path);
+}
+
+// Offsets and ids of a corrupt file are only checked when a tile is read, and such tiles read as empty.
+static void testCorruptMapFile() {
+  auto p = umg::compile({program});
+  umg::GenerationContext context;
+  CHECK(umg::generate(p, context, 10, 10, 1));
+  const char* path = "umgl_test_map.bin";
+  MapFileWriter writer(path, Vec2(10, 10));
+  writer.addBand(context.getMap().elems, Rectangle(10, 10));
+  CHECK(writer.finish());
+  string contents;
+  {
+    std::ifstream in(path, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  MapFileHeader header;
+  memcpy(&header, contents.data(), sizeof(header));
+  MapFileBand band;
+  memcpy(&band, contents.data() + header.bandsOffset, sizeof(band));
+  // The end of tile 3 is past all ids, and the first id of tile 5 is out of range.
+  uint32_t offsets[7];
+  memcpy(offsets, contents.data() + band.offset, sizeof(offsets));
+  CHECK(offsets[6] > offsets[5]);
+  uint32_t badOffset = 1000000;
+  uint32_t badId = header.numTokens;
+  memcpy(&contents[band.offset + 4 * sizeof(uint32_t)], &badOffset, sizeof(badOffset));
+  memcpy(&contents[band.offset + (101 + offsets[5]) * sizeof(uint32_t)], &badId, sizeof(badId));
+  {
+    std::ofstream out(path, std::ios::binary);
+    out.write(contents.data(), contents.size());
+  }
+  {
+    MapFileReader reader(path);
+    CHECK(reader.good());
+    CHECK(reader.getTile(0, 3).size() == 0 && reader.getTile(0, 4).size() == 0);
+    CHECK(reader.getTile(0, 2).size() > 0);
+    auto tile = reader.getTile(0, 5);
+    CHECK(tile.size() > 0 && reader.getTokenName(*tile.begin()).empty());
+  }
+  std::remove(path);
+}
+
+// Dijkstra and BfSearch as they were written with a map and a set, to compare the results with.
+static map<Vec2, double> getReferenceDistances(Rectangle bounds, const vector<Vec2>& from, int maxDist,
+    function<double(Vec2)> entryFun) {
+  map<Vec2, double> ret;
+  std::priority_queue<pair<double, Vec2>, std::vector<pair<double, Vec2>>, std::greater<pair<double, Vec2>>> q;
+  for (auto v : from)
+    if (v.inRectangle(bounds))
+      q.push(make_pair(0.0, v));
+  while (!q.empty()) {
+    auto [dist, pos] = q.top();
+    q.pop();
+    if (ret.count(pos))
+      continue;
+    ret[pos] = dist;
+    for (auto dir : Vec2::directions8())
+      if ((pos + dir).inRectangle(bounds) && !ret.count(pos + dir) && dist + entryFun(pos + dir) <= maxDist)
+        q.push(make_pair(dist + entryFun(pos + dir), pos + dir));
+  }
+  return ret;
+}
+
+static set<Vec2> getReferenceReachable(Rectangle bounds, Vec2 from, function<bool(Vec2)> entryFun) {
+  set<Vec2> ret;
+  if (!from.inRectangle(bounds))
+    return ret;
+  std::queue<Vec2> q;
+  ret.insert(from);
+  q.push(from);
+  while (!q.empty()) {
+    auto pos = q.front();
+    q.pop();
+    for (auto dir : Vec2::directions8())
+      if ((pos + dir).inRectangle(bounds) && !ret.count(pos + dir) && entryFun(pos + dir)) {
+        ret.insert(pos + dir);
+        q.push(pos + dir);
+      }
+  }
+  return ret;
+}
+
+// Random walls and costs, with starting points that repeat or lie outside of the bounds.
+static void testSearches() {
+  RandomGen random;
+  random.init(1);
+  Rectangle bounds(3, 5, 60, 50);
+  Table<double> costs(bounds);
+  for (auto v : bounds)
+    costs[v] = random.choose(vector<double>{1, 1.5, 2, ShortestPath::infinity});
+  auto entryFun = [&] (Vec2 v) { return costs[v]; };
+  auto isOpen = [&] (Vec2 v) { return costs[v] < ShortestPath::infinity; };
+  vector<Vec2> from {Vec2(10, 10), Vec2(40, 30), Vec2(10, 10), Vec2(0, 0), Vec2(60, 20)};
+  for (int maxDist : {5, 20, 1000}) {
+    Dijkstra dijkstra(bounds, from, maxDist, entryFun);
+    auto expected = getReferenceDistances(bounds, from, maxDist, entryFun);
+    CHECK(dijkstra.getAllReachable() == expected);
+    for (auto v : Rectangle(0, 0, 65, 60)) {
+      CHECK(dijkstra.isReachable(v) == expected.count(v));
+      if (expected.count(v))
+        CHECK(dijkstra.getDist(v) == expected.at(v));
+    }
+  }
+  for (auto start : {Vec2(10, 10), Vec2(59, 54), Vec2(0, 0)}) {
+    BfSearch search(bounds, start, isOpen);
+    auto expected = getReferenceReachable(bounds, start, isOpen);
+    CHECK(search.getAllReachable() == expected);
+    for (auto v : Rectangle(0, 0, 65, 60))
+      CHECK(search.isReachable(v) == expected.count(v));
+  }
+}
+
+// Position can run its generator outside of its band, so a program that reads or clears tiles below it can't be
+// streamed.
+static auto getBands(const string& position) {
+  auto p = umg::compile({"SplitH(0.5, { Reset(\"floor\") " + position + " }, Reset(\"wall\"))"});
+  return getStreamingBands(p.getGenerator(), Rectangle(20, 20));
+}
+
+static void testStreamingPosition() {
+  CHECK(!!getBands("Position(position = MIDDLE, size = {4, 4}, generator = Set(\"table\"))"));
+  CHECK(!!getBands("Filter(On(\"floor\"), Set(\"table\"))"));
+  CHECK(!getBands("Position(position = MIDDLE, size = {4, 4}, generator = Filter(On(\"floor\"), Set(\"table\")))"));
+  CHECK(!getBands("Position(position = MIDDLE, size = {4, 4}, generator = Remove(\"floor\"))"));
+}
+
+int main() {
+  testProgramAssignment();
+  testSmallVectorSelfPush();
+  testConnectUnreachable();
+  testStampPositionOutside();
+  testReroll();
+  testPositionalMetric();
+  testRandomWithoutInit();
+  testCumulativeWeights();
+  testMapFileBands();
+  testCorruptMapFile();
+  testSearches();
+  testStreamingPosition();
+  std::cout << "All tests passed\n";
+  return 0;
+}